@@ -3,9 +3,15 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "strings.h"
 
 #ifdef SDL2SUBDIR
@@ -15,8 +21,11 @@
 #endif
 
 #include "zip.h"
+#define MINIZ_HEADER_FILE_ONLY // implemented in zip.c
+#include "miniz.h"
 
 #include "snes.h"
+#include "rewind.h"
 #include "tracing.h"
 
 /* depends on behaviour:
@@ -37,6 +46,19 @@ shifting into sign bit makes value negative
   int a = ((int16_t) (0x1fff << 3)) >> 3; a == -1
 */
 
+typedef struct IoJob IoJob;
+
+struct IoJob {
+  IoJob* next;
+  char* path;
+  uint8_t* data;
+  int size;
+  bool compress;
+  const char* what; // for reporting
+  uint8_t* map; // instead syncs this mapped file (size bytes) if set, and unmaps it after if unmap is set
+  bool unmap;
+};
+
 static struct {
   // rendering
   SDL_Window* window;
@@ -45,14 +67,56 @@ static struct {
   // audio
   SDL_AudioDeviceID audioDevice;
   int audioFrequency;
-  int16_t* audioBuffer;
   // paths
   char* prefPath;
   char* pathSeparator;
   // snes, timing
   Snes* snes;
-  float wantedFrames;
-  int wantedSamples;
+  int wantedSamples; // generated samples per frame, audio is pulled by the callback and paces emulation
+  atomic_bool turbo; // runs 2 frames per frame, the callback consumes audio twice as fast
+  // rewind, captured after every frame
+  Rewind* rewind;
+  bool rewinding; // steps back a capture per frame
+  uint32_t timedFrames; // for reporting the capture cost
+  uint64_t frameTicks;
+  uint64_t captureTicks;
+  // run-ahead, frames the shown picture is ahead of the emulation
+  int runAhead;
+  uint8_t* runAheadState; // room for a state of the loaded rom
+  uint32_t aheadFrames[2][4]; // for reporting the cost, per mode and setting
+  uint64_t aheadTicks[2][4];
+  Snes* shownSnes; // instance the picture is taken from
+  // threaded run-ahead: a second instance keeps running ahead with the last input held, and is only
+  // synced from the primary when the input differs from that prediction (NULL if not available)
+  Snes* aheadSnes;
+  bool aheadThreaded;
+  bool aheadValid; // aheadSnes is the primary plus runAhead predicted frames
+  uint16_t aheadInput[2]; // the prediction
+  uint32_t aheadSyncs;
+  SDL_Thread* aheadThread;
+  SDL_sem* aheadStart;
+  SDL_sem* aheadDone;
+  int aheadJob; // frames for the thread to run (the last one rendered), 0 to quit
+  // states are saved compressed ('LSSZ', uncompressed size, zlib stream), loading takes either
+  bool compressStates;
+  // states and battery data are written by a worker thread, to a temporary file that then replaces the
+  // old one; it posts an ioEvent event for each finished write
+  SDL_Thread* ioThread;
+  SDL_mutex* ioMutex;
+  SDL_cond* ioCond; // signaled when a job is queued or finished
+  IoJob* ioFirst;
+  IoJob* ioLast;
+  int ioPending; // queued or being written
+  bool ioQuit;
+  Uint32 ioEvent;
+  // the save file is mapped into memory where possible, and after every frame that is kept (so not the
+  // run-ahead ones, and not while rewinding) the battery ram pages written are copied to it; every second
+  // the worker syncs it to disk if that changed it
+  uint8_t* batteryMap;
+  int batterySize;
+  uint32_t batteryEpoch; // written pages since are not copied yet
+  bool batteryWritten; // copied to since the last sync
+  uint32_t batterySyncTime;
   // loaded rom
   bool loaded;
   char* romName;
@@ -61,16 +125,38 @@ static struct {
 } glb = {};
 
 static uint8_t* readFile(const char* name, int* length);
+static bool writeFile(const char* name, const uint8_t* data, int size, bool compress);
+static uint8_t* readState(const char* name, int* size);
+static void queueWrite(const char* name, uint8_t* data, int size, bool compress, const char* what);
+static void pushJob(IoJob* job);
+static void waitForWrites(void);
+static void reportWrite(const SDL_Event* event);
+static int ioThreadMain(void* data);
+static bool mapBattery(void);
+static void commitBattery(void);
+static void syncBattery(bool unmap);
 static void loadRom(const char* path);
 static void closeRom(void);
 static void setPaths(const char* path);
 static void setTitle(const char* path);
 static bool checkExtention(const char* name, bool forZip);
-static void playAudio(void);
+static void audioCallback(void* userdata, Uint8* stream, int len);
 static void renderScreen(void);
 static void handleInput(int keyCode, bool pressed);
+static void printRunAheadCost(void);
+static void runFrameAheadThreaded(void);
+static int aheadThreadMain(void* data);
+static int runStress(const char* path, int instances, int frames);
+static int runBench(const char* path, int frames, int saveInterval);
+static int stressThreadMain(void* data);
 
 int main(int argc, char** argv) {
+  if(argc >= 3 && strcmp(argv[1], "--stress") == 0) {
+    return runStress(argv[2], argc >= 4 ? atoi(argv[3]) : 4, argc >= 5 ? atoi(argv[4]) : 600);
+  }
+  if(argc >= 3 && strcmp(argv[1], "--bench") == 0) {
+    return runBench(argv[2], argc >= 4 ? atoi(argv[3]) : 600, argc >= 5 ? atoi(argv[4]) : 0);
+  }
   // set up SDL
   if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
     printf("Failed to init SDL: %s\n", SDL_GetError());
@@ -118,15 +204,13 @@ int main(int argc, char** argv) {
   want.freq = glb.audioFrequency;
   want.format = AUDIO_S16;
   want.channels = 2;
-  want.samples = 2048;
-  want.callback = NULL; // use queue
+  want.samples = 512;
+  want.callback = audioCallback;
   glb.audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
   if(glb.audioDevice == 0) {
     printf("Failed to open audio device: %s\n", SDL_GetError());
     return 1;
   }
-  glb.audioBuffer = malloc(glb.audioFrequency / 50 * 4); // *2 for stereo, *2 for sizeof(int16)
-  SDL_PauseAudioDevice(glb.audioDevice, 0);
   // print version
   SDL_version version;
   SDL_version compiledVersion;
@@ -138,12 +222,43 @@ int main(int argc, char** argv) {
   );
   // init snes, load rom
   glb.snes = snes_init();
-  glb.wantedFrames = 1.0 / 60.0;
-  glb.wantedSamples = glb.audioFrequency / 60;
+  glb.wantedSamples = SNES_SAMPLE_RATE / 60;
+  glb.turbo = false;
+  glb.rewind = rewind_init(glb.snes, 32 * 1024 * 1024, 1); // 32MB, usually a few minutes
+  glb.rewinding = false;
+  glb.timedFrames = 0;
+  glb.frameTicks = 0;
+  glb.captureTicks = 0;
+  glb.runAhead = 0;
+  glb.runAheadState = NULL;
+  glb.shownSnes = glb.snes;
+  glb.aheadSnes = NULL;
+  glb.aheadThreaded = false;
+  glb.aheadValid = false;
+  glb.aheadSyncs = 0;
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
+  // the embedded build (TARGET_GNW without LINUX_EMU) has a single, static instance
+  glb.aheadSnes = snes_init();
+  glb.aheadSnes->apu->dsp->skipOutput = true;
+  glb.aheadStart = SDL_CreateSemaphore(0);
+  glb.aheadDone = SDL_CreateSemaphore(0);
+  glb.aheadThread = SDL_CreateThread(aheadThreadMain, "run-ahead", NULL);
+#endif
+  glb.compressStates = true;
+  glb.ioMutex = SDL_CreateMutex();
+  glb.ioCond = SDL_CreateCond();
+  glb.ioFirst = NULL;
+  glb.ioLast = NULL;
+  glb.ioPending = 0;
+  glb.ioQuit = false;
+  glb.ioEvent = SDL_RegisterEvents(1);
+  glb.ioThread = SDL_CreateThread(ioThreadMain, "file writes", NULL);
+  glb.batteryMap = NULL;
   glb.loaded = false;
   glb.romName = NULL;
   glb.savePath = NULL;
   glb.statePath = NULL;
+  SDL_PauseAudioDevice(glb.audioDevice, 0); // starts pulling samples from the snes
   if(argc >= 2) {
     loadRom(argv[1]);
   } else {
@@ -153,24 +268,61 @@ int main(int argc, char** argv) {
   bool running = true;
   bool paused = false;
   bool runOne = false;
-  bool turbo = false;
   SDL_Event event;
   int fullscreenFlags = 0;
-  // timing
-  uint64_t countFreq = SDL_GetPerformanceFrequency();
-  uint64_t lastCount = SDL_GetPerformanceCounter();
-  float timeAdder = 0.0;
 
   while(running) {
     while(SDL_PollEvent(&event)) {
       switch(event.type) {
         case SDL_KEYDOWN: {
           switch(event.key.keysym.sym) {
-            case SDLK_r: snes_reset(glb.snes, false); break;
-            case SDLK_e: snes_reset(glb.snes, true); break;
+            case SDLK_r: {
+              SDL_LockAudioDevice(glb.audioDevice);
+              snes_reset(glb.snes, false);
+              SDL_UnlockAudioDevice(glb.audioDevice);
+              rewind_reset(glb.rewind);
+              glb.aheadValid = false;
+              break;
+            }
+            case SDLK_e: {
+              SDL_LockAudioDevice(glb.audioDevice);
+              snes_reset(glb.snes, true);
+              SDL_UnlockAudioDevice(glb.audioDevice);
+              rewind_reset(glb.rewind);
+              glb.aheadValid = false;
+              break;
+            }
             case SDLK_o: runOne = true; break;
             case SDLK_p: paused = !paused; break;
-            case SDLK_t: turbo = true; break;
+            case SDLK_t: glb.turbo = true; break;
+            case SDLK_BACKSPACE: {
+              if(event.key.repeat) break;
+              glb.rewinding = true;
+              Rewind* rw = glb.rewind;
+              printf(
+                "Rewinding, %d captures in %d KB (avg %d bytes), capture %.1f us per frame (%.2f%% of emulation time)\n",
+                rw->count, rw->usedBytes / 1024, rw->captures > 1 ? (int) (rw->packedBytes / (rw->captures - 1)) : 0,
+                glb.timedFrames > 0 ? glb.captureTicks * 1e6 / SDL_GetPerformanceFrequency() / glb.timedFrames : 0.0,
+                glb.frameTicks > 0 ? glb.captureTicks * 100.0 / glb.frameTicks : 0.0
+              );
+              break;
+            }
+            case SDLK_y: {
+              glb.runAhead = (glb.runAhead + 1) % 4;
+              glb.aheadValid = false;
+              printRunAheadCost();
+              break;
+            }
+            case SDLK_u: {
+              if(glb.aheadSnes == NULL) {
+                puts("Threaded run-ahead needs a second instance, which this build does not have");
+                break;
+              }
+              glb.aheadThreaded = !glb.aheadThreaded;
+              glb.aheadValid = false;
+              printRunAheadCost();
+              break;
+            }
             case SDLK_j: {
               char* filePath = malloc(strlen(glb.prefPath) + 9); // "dump.bin" (8) + '\0'
               strcpy(filePath, glb.prefPath);
@@ -213,30 +365,34 @@ int main(int argc, char** argv) {
               int size = snes_saveState(glb.snes, NULL);
               uint8_t* stateData = malloc(size);
               snes_saveState(glb.snes, stateData);
-              FILE* f = fopen(glb.statePath, "wb");
-              if(f != NULL) {
-                fwrite(stateData, size, 1, f);
-                fclose(f);
-                puts("Saved state");
-              } else {
-                puts("Failed to save state");
-              }
-              free(stateData);
+              // compressed and written by the worker, which frees stateData
+              queueWrite(glb.statePath, stateData, size, glb.compressStates, "state");
+              break;
+            }
+            case SDLK_f: {
+              glb.compressStates = !glb.compressStates;
+              printf("Saving states %s\n", glb.compressStates ? "compressed" : "uncompressed");
               break;
             }
             case SDLK_n: {
-              // load state
+              // load state, after a save to it is written
+              waitForWrites();
               int size = 0;
-              uint8_t* stateData = readFile(glb.statePath, &size);
+              uint8_t* stateData = readState(glb.statePath, &size);
               if(stateData != NULL) {
-                if(snes_loadState(glb.snes, stateData, size)) {
+                SDL_LockAudioDevice(glb.audioDevice);
+                bool loaded = snes_loadState(glb.snes, stateData, size);
+                SDL_UnlockAudioDevice(glb.audioDevice);
+                rewind_reset(glb.rewind);
+                glb.aheadValid = false;
+                if(loaded) {
                   puts("Loaded state");
                 } else {
                   puts("Failed to load state, file contents invalid");
                 }
                 free(stateData);
               } else {
-                puts("Failed to load state, failed to read file");
+                puts("Failed to load state, failed to read or decompress file");
               }
               break;
             }
@@ -256,7 +412,8 @@ int main(int argc, char** argv) {
         }
         case SDL_KEYUP: {
           switch(event.key.keysym.sym) {
-            case SDLK_t: turbo = false; break;
+            case SDLK_t: glb.turbo = false; break;
+            case SDLK_BACKSPACE: glb.rewinding = false; break;
           }
           handleInput(event.key.keysym.sym, false);
           break;
@@ -271,27 +428,63 @@ int main(int argc, char** argv) {
           SDL_free(droppedFile);
           break;
         }
+        default: {
+          if(event.type == glb.ioEvent) reportWrite(&event);
+          break;
+        }
       }
     }
 
-    uint64_t curCount = SDL_GetPerformanceCounter();
-    uint64_t delta = curCount - lastCount;
-    lastCount = curCount;
-    float seconds = delta / (float) countFreq;
-    timeAdder += seconds;
-    // allow 2 ms earlier, to prevent skipping due to being just below wanted
-    while(timeAdder >= glb.wantedFrames - 0.002) {
-      timeAdder -= glb.wantedFrames;
-      // run frame
-      if(glb.loaded && (!paused || runOne)) {
-        runOne = false;
-        if(turbo) {
-          snes_runFrame(glb.snes);
-        }
+    // run frames until 1.5 frames of audio are queued for the callback, so the audio device paces
+    // emulation (at most 4 per loop, to stay responsive if the device stalls); less in turbo, where
+    // frames produce twice the samples, so that the 2048-sample ring never overflows
+    bool ranFrame = false;
+    for(int i = 0; i < 4; i++) {
+      if(!glb.loaded || (paused && !runOne)) break;
+      int wanted = glb.turbo ? glb.wantedSamples / 2 : glb.wantedSamples * 3 / 2;
+      if(!runOne && snes_getQueuedSamples(glb.snes) >= wanted) break;
+      runOne = false;
+      if(glb.rewinding) {
+        // stays at the oldest capture when there are no more
+        SDL_LockAudioDevice(glb.audioDevice);
+        bool stepped = rewind_step(glb.rewind);
+        SDL_UnlockAudioDevice(glb.audioDevice);
+        if(!stepped) break;
         snes_runFrame(glb.snes);
-        playAudio();
-        renderScreen();
+        glb.shownSnes = glb.snes;
+        glb.aheadValid = false;
+        ranFrame = true;
+        continue;
+      }
+      bool threaded = glb.aheadThreaded && glb.runAhead > 0;
+      for(int j = 0; j < (glb.turbo ? 2 : 1); j++) {
+        // only the last frame is shown, so only that one needs to run ahead (the second instance has
+        // to follow every frame, though)
+        int ahead = j == (glb.turbo ? 1 : 0) || threaded ? glb.runAhead : 0;
+        uint64_t start = SDL_GetPerformanceCounter();
+        if(threaded) {
+          runFrameAheadThreaded();
+        } else {
+          snes_runFrameAhead(glb.snes, ahead, glb.runAheadState);
+          glb.shownSnes = glb.snes;
+          glb.aheadValid = false;
+        }
+        uint64_t ran = SDL_GetPerformanceCounter();
+        rewind_capture(glb.rewind);
+        glb.aheadTicks[threaded][ahead] += ran - start;
+        glb.aheadFrames[threaded][ahead]++;
+        glb.frameTicks += ran - start;
+        glb.captureTicks += SDL_GetPerformanceCounter() - ran;
+        glb.timedFrames++;
       }
+      if(glb.batteryMap != NULL) commitBattery();
+      ranFrame = true;
+    }
+    if(glb.batteryMap != NULL && SDL_GetTicks() - glb.batterySyncTime >= 1000) syncBattery(false);
+    if(ranFrame) {
+      renderScreen();
+    } else {
+      SDL_Delay(1); // in case presenting does not wait for vsync
     }
 
     SDL_RenderClear(glb.renderer);
@@ -300,12 +493,32 @@ int main(int argc, char** argv) {
   }
   // close rom (saves battery)
   closeRom();
+  // let the worker finish the writes
+  SDL_LockMutex(glb.ioMutex);
+  glb.ioQuit = true;
+  SDL_CondBroadcast(glb.ioCond);
+  SDL_UnlockMutex(glb.ioMutex);
+  SDL_WaitThread(glb.ioThread, NULL);
+  while(SDL_PollEvent(&event)) {
+    if(event.type == glb.ioEvent) reportWrite(&event);
+  }
+  SDL_DestroyCond(glb.ioCond);
+  SDL_DestroyMutex(glb.ioMutex);
   // free snes
+  rewind_free(glb.rewind);
+  free(glb.runAheadState);
+  if(glb.aheadSnes != NULL) {
+    glb.aheadJob = 0;
+    SDL_SemPost(glb.aheadStart);
+    SDL_WaitThread(glb.aheadThread, NULL);
+    SDL_DestroySemaphore(glb.aheadStart);
+    SDL_DestroySemaphore(glb.aheadDone);
+    snes_free(glb.aheadSnes);
+  }
   snes_free(glb.snes);
   // clean sdl and free global allocs
   SDL_PauseAudioDevice(glb.audioDevice, 1);
   SDL_CloseAudioDevice(glb.audioDevice);
-  free(glb.audioBuffer);
   SDL_free(glb.prefPath);
   if(glb.romName) free(glb.romName);
   if(glb.savePath) free(glb.savePath);
@@ -317,12 +530,15 @@ int main(int argc, char** argv) {
   return 0;
 }
 
-static void playAudio() {
-  snes_setSamples(glb.snes, glb.audioBuffer, glb.wantedSamples);
-  if(SDL_GetQueuedAudioSize(glb.audioDevice) <= glb.wantedSamples * 4 * 6) {
-    // don't queue audio if buffer is still filled
-    SDL_QueueAudio(glb.audioDevice, glb.audioBuffer, glb.wantedSamples * 4);
-  }
+static void audioCallback(void* userdata, Uint8* stream, int len) {
+  // pull samples from the snes, nudging the rate by up to 0.5% to keep about 2 frames queued,
+  // which absorbs the difference between the emulation and display / audio clocks
+  int queued = snes_getQueuedSamples(glb.snes);
+  double fill = (queued - glb.wantedSamples * 2) / (double) glb.wantedSamples;
+  if(fill > 1.0) fill = 1.0;
+  if(fill < -1.0) fill = -1.0;
+  double ratio = SNES_SAMPLE_RATE / (double) glb.audioFrequency * (1.0 + 0.005 * fill) * (glb.turbo ? 2 : 1);
+  snes_pullSamples(glb.snes, (int16_t*) stream, len / 4, ratio);
 }
 
 static void renderScreen() {
@@ -332,7 +548,7 @@ static void renderScreen() {
     printf("Failed to lock texture: %s\n", SDL_GetError());
     return;
   }
-  snes_setPixels(glb.snes, (uint8_t*) pixels);
+  snes_setPixels(glb.shownSnes, (uint8_t*) pixels);
   SDL_UnlockTexture(glb.texture);
   
   SDL_RenderClear(glb.renderer);
@@ -340,6 +556,288 @@ static void renderScreen() {
   SDL_RenderPresent(glb.renderer);
 }
 
+static void printRunAheadCost() {
+  printf(
+    "Run-ahead %d frames%s, %u syncs of the second instance (emulation per frame:",
+    glb.runAhead, glb.aheadThreaded ? " on a second instance" : "", glb.aheadSyncs
+  );
+  double base = 0.0;
+  for(int threaded = 0; threaded < 2; threaded++) {
+    for(int i = 0; i < 4; i++) {
+      if(glb.aheadFrames[threaded][i] == 0) continue;
+      double time = glb.aheadTicks[threaded][i] * 1e6 / SDL_GetPerformanceFrequency() / glb.aheadFrames[threaded][i];
+      if(threaded == 0 && i == 0) base = time;
+      printf(" %.0f us at %d%s", time, i, threaded ? " threaded" : "");
+      if(i > 0 && base > 0.0) printf(" (+%.0f us)", time - base);
+      printf(";");
+    }
+  }
+  puts(")");
+}
+
+static void runFrameAheadThreaded() {
+  // the primary runs the real frame (for its audio) while the second instance runs one frame further
+  // ahead; if the input is not what the second instance assumed, it is synced to the primary and runs
+  // all frames again (which costs as much as single-instance run-ahead)
+  uint16_t input1 = glb.snes->input1->currentState;
+  uint16_t input2 = glb.snes->input2->currentState;
+  bool predicted = glb.aheadValid && input1 == glb.aheadInput[0] && input2 == glb.aheadInput[1];
+  if(predicted) {
+    glb.aheadJob = 1;
+    SDL_SemPost(glb.aheadStart);
+  }
+  glb.snes->ppu->skipRender = true;
+  snes_runFrame(glb.snes);
+  glb.snes->ppu->skipRender = false;
+  if(!predicted) {
+    // the held input is part of the state
+    int size = snes_saveState(glb.snes, glb.runAheadState);
+    snes_loadState(glb.aheadSnes, glb.runAheadState, size);
+    glb.aheadInput[0] = input1;
+    glb.aheadInput[1] = input2;
+    glb.aheadValid = true;
+    glb.aheadSyncs++;
+    glb.aheadJob = glb.runAhead;
+    SDL_SemPost(glb.aheadStart);
+  }
+  SDL_SemWait(glb.aheadDone);
+  glb.shownSnes = glb.aheadSnes;
+}
+
+static int aheadThreadMain(void* data) {
+  while(true) {
+    SDL_SemWait(glb.aheadStart);
+    int frames = glb.aheadJob;
+    if(frames == 0) break;
+    for(int i = 0; i < frames; i++) {
+      glb.aheadSnes->ppu->skipRender = i < frames - 1;
+      snes_runFrame(glb.aheadSnes);
+    }
+    SDL_SemPost(glb.aheadDone);
+  }
+  return 0;
+}
+
+typedef struct StressRun {
+  Snes* snes;
+  int frames;
+  uint64_t hash;
+  uint64_t videoHash; // without the audio, which after snes_restore goes on from the instance's own ring
+} StressRun;
+
+static uint64_t stressHash(uint64_t hash, const void* data, int size) {
+  // fnv-1a
+  const uint8_t* bytes = data;
+  for(int i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static int stressThreadMain(void* data) {
+  // runs with scripted input and hashes every frame's video and audio, and the state at the end
+  StressRun* run = data;
+  uint8_t* pixels = calloc(320 * 240 * 2, 1);
+  int16_t* samples = calloc(800 * 2, sizeof(int16_t));
+  uint64_t hash = 0xcbf29ce484222325ull;
+  uint64_t videoHash = hash;
+  for(int i = 0; i < run->frames; i++) {
+    snes_setButtonState(run->snes, 1, 4 + (i / 30) % 4, (i % 30) < 15);
+    snes_runFrame(run->snes);
+    snes_setPixels(run->snes, pixels);
+    snes_setSamples(run->snes, samples, 800);
+    hash = stressHash(hash, pixels, 320 * 240 * 2);
+    hash = stressHash(hash, samples, 800 * 2 * sizeof(int16_t));
+    videoHash = stressHash(videoHash, pixels, 320 * 240 * 2);
+  }
+  int size = snes_saveState(run->snes, NULL);
+  uint8_t* state = malloc(size);
+  snes_saveState(run->snes, state);
+  run->hash = stressHash(hash, state, size);
+  run->videoHash = stressHash(videoHash, state, size);
+  free(state);
+  free(samples);
+  free(pixels);
+  return 0;
+}
+
+static int runStress(const char* path, int instances, int frames) {
+  // runs the rom on one instance, then on several instances on their own threads at once; all of them
+  // have to end up with the same hash, which they only do if the instances share no state
+#if defined(TARGET_GNW) && !defined(LINUX_EMU)
+  printf("Stress test not available, TARGET_GNW has a single, static instance\n");
+  return 1;
+#else
+  int length = 0;
+  uint8_t* file = readFile(path, &length);
+  if(file == NULL) {
+    printf("Failed to read file '%s'\n", path);
+    return 1;
+  }
+  if(instances < 1) instances = 1;
+  if(frames < 1) frames = 1;
+  StressRun* runs = malloc((instances + 1) * sizeof(StressRun));
+  for(int i = 0; i <= instances; i++) {
+    runs[i].snes = snes_init();
+    runs[i].frames = frames;
+    runs[i].hash = 0;
+    if(!snes_loadRom(runs[i].snes, file, length)) {
+      printf("Failed to load rom\n");
+      for(int j = 0; j <= i; j++) snes_free(runs[j].snes);
+      free(runs);
+      free(file);
+      return 1;
+    }
+  }
+  // the first one is the single-instance reference
+  stressThreadMain(&runs[0]);
+  printf("Reference: %016llx\n", (unsigned long long) runs[0].hash);
+  SDL_Thread** threads = malloc(instances * sizeof(SDL_Thread*));
+  uint64_t start = SDL_GetPerformanceCounter();
+  for(int i = 0; i < instances; i++) {
+    threads[i] = SDL_CreateThread(stressThreadMain, "stress", &runs[i + 1]);
+  }
+  for(int i = 0; i < instances; i++) {
+    SDL_WaitThread(threads[i], NULL);
+  }
+  double time = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+  int mismatches = 0;
+  for(int i = 1; i <= instances; i++) {
+    bool same = runs[i].hash == runs[0].hash;
+    if(!same) mismatches++;
+    printf("Instance %d: %016llx%s\n", i, (unsigned long long) runs[i].hash, same ? "" : " (mismatch)");
+  }
+  printf(
+    "%d instances, %d frames each: %s, %.1f frames per second in total\n",
+    instances, frames, mismatches == 0 ? "all match" : "mismatch", instances * frames / time
+  );
+  // a clone has to go on exactly as the reference does, and the reference restored from a snapshot taken
+  // before that has to go through the same frames and states again
+  StressRun clone = {snes_clone(runs[0].snes), frames, 0, 0};
+  int size = snes_snapshot(runs[0].snes, NULL);
+  uint8_t* snapshot = malloc(size);
+  snes_snapshot(runs[0].snes, snapshot);
+  stressThreadMain(&clone);
+  stressThreadMain(&runs[0]);
+  bool cloneSame = clone.hash == runs[0].hash;
+  uint64_t videoHash = runs[0].videoHash;
+  bool restored = snes_restore(runs[0].snes, snapshot, size);
+  stressThreadMain(&runs[0]);
+  bool restoreSame = restored && runs[0].videoHash == videoHash;
+  printf(
+    "Clone: %016llx%s, restored: %016llx%s\n", (unsigned long long) clone.hash, cloneSame ? "" : " (mismatch)",
+    (unsigned long long) runs[0].videoHash, restoreSame ? "" : " (mismatch)"
+  );
+  if(!cloneSame || !restoreSame) mismatches++;
+  free(snapshot);
+  snes_free(clone.snes);
+  for(int i = 0; i <= instances; i++) snes_free(runs[i].snes);
+  free(threads);
+  free(runs);
+  free(file);
+  return mismatches == 0 ? 0 : 1;
+#endif
+}
+
+static int runBench(const char* path, int frames, int saveInterval) {
+  // runs the rom without a window, with the same scripted input as --stress, and reports how long its
+  // frames take (rendering included); with a save interval, every that many frames a state is saved and
+  // the mapped battery ram synced through the worker, and the frames that ran while it was writing are
+  // reported on their own
+  int length = 0;
+  uint8_t* file = readFile(path, &length);
+  if(file == NULL) {
+    printf("Failed to read file '%s'\n", path);
+    return 1;
+  }
+  Snes* snes = snes_init();
+  if(!snes_loadRom(snes, file, length)) {
+    printf("Failed to load rom\n");
+    snes_free(snes);
+    free(file);
+    return 1;
+  }
+  if(frames < 1) frames = 1;
+  if(saveInterval > 0) {
+    // writes to files next to the rom, removed afterwards
+    glb.snes = snes;
+    glb.savePath = malloc(strlen(path) + 11);
+    strcpy(glb.savePath, path);
+    strcat(glb.savePath, ".bench.srm");
+    glb.statePath = malloc(strlen(path) + 11);
+    strcpy(glb.statePath, path);
+    strcat(glb.statePath, ".bench.lss");
+    remove(glb.savePath);
+    glb.compressStates = true;
+    glb.ioMutex = SDL_CreateMutex();
+    glb.ioCond = SDL_CreateCond();
+    glb.ioEvent = (Uint32) -1; // no event loop to report to
+    glb.ioThread = SDL_CreateThread(ioThreadMain, "file writes", NULL);
+    if(!mapBattery()) printf("No mapped battery ram, only saving states\n");
+  }
+  uint8_t* pixels = calloc(320 * 240 * 2, 1);
+  double frequency = SDL_GetPerformanceFrequency();
+  uint64_t total = 0, worst = 0, writingTotal = 0, writingWorst = 0;
+  int writingFrames = 0, saves = 0;
+  for(int i = 0; i < frames; i++) {
+    uint64_t start = SDL_GetPerformanceCounter();
+    if(saveInterval > 0 && i % saveInterval == saveInterval - 1) {
+      int size = snes_saveState(snes, NULL);
+      uint8_t* stateData = malloc(size);
+      snes_saveState(snes, stateData);
+      queueWrite(glb.statePath, stateData, size, glb.compressStates, "state");
+      if(glb.batteryMap != NULL) syncBattery(false);
+      saves++;
+    }
+    snes_setButtonState(snes, 1, 4 + (i / 30) % 4, (i % 30) < 15);
+    snes_runFrame(snes);
+    snes_setPixels(snes, pixels);
+    if(glb.batteryMap != NULL) commitBattery();
+    uint64_t time = SDL_GetPerformanceCounter() - start;
+    total += time;
+    if(time > worst) worst = time;
+    if(saveInterval > 0) {
+      // counts if a write was still going when the frame was done
+      SDL_LockMutex(glb.ioMutex);
+      bool writing = glb.ioPending > 0;
+      SDL_UnlockMutex(glb.ioMutex);
+      if(writing) {
+        writingFrames++;
+        writingTotal += time;
+        if(time > writingWorst) writingWorst = time;
+      }
+    }
+  }
+  printf(
+    "%d frames: %.3f ms per frame on average, %.3f ms at most\n",
+    frames, total * 1000.0 / frequency / frames, worst * 1000.0 / frequency
+  );
+  if(saveInterval > 0) {
+    if(glb.batteryMap != NULL) syncBattery(true);
+    SDL_LockMutex(glb.ioMutex);
+    glb.ioQuit = true;
+    SDL_CondBroadcast(glb.ioCond);
+    SDL_UnlockMutex(glb.ioMutex);
+    SDL_WaitThread(glb.ioThread, NULL);
+    printf(
+      "%d saves, %d frames ran while writing: %.3f ms per frame on average, %.3f ms at most\n", saves,
+      writingFrames, writingFrames > 0 ? writingTotal * 1000.0 / frequency / writingFrames : 0.0,
+      writingWorst * 1000.0 / frequency
+    );
+    remove(glb.savePath);
+    remove(glb.statePath);
+    free(glb.savePath);
+    free(glb.statePath);
+    SDL_DestroyCond(glb.ioCond);
+    SDL_DestroyMutex(glb.ioMutex);
+  }
+  free(pixels);
+  snes_free(snes);
+  free(file);
+  return 0;
+}
+
 static void handleInput(int keyCode, bool pressed) {
   switch(keyCode) {
     case SDLK_z: snes_setButtonState(glb.snes, 1, 0, pressed); break;
@@ -402,17 +900,20 @@ static void loadRom(const char* path) {
   // close currently loaded rom (saves battery)
   closeRom();
   // load new rom
-  if(snes_loadRom(glb.snes, file, length)) {
+  SDL_LockAudioDevice(glb.audioDevice);
+  bool loaded = snes_loadRom(glb.snes, file, length);
+  // set wantedSamples
+  glb.wantedSamples = SNES_SAMPLE_RATE / (glb.snes->palTiming ? 50 : 60);
+  SDL_UnlockAudioDevice(glb.audioDevice);
+  if(loaded) {
     // get rom name and paths, set title
     setPaths(path);
     setTitle(glb.romName);
-    // set wantedFrames and wantedSamples
-    glb.wantedFrames = 1.0 / (glb.snes->palTiming ? 50.0 : 60.0);
-    glb.wantedSamples = glb.audioFrequency / (glb.snes->palTiming ? 50 : 60);
     glb.loaded = true;
-    // load battery for loaded rom
+    // load battery for loaded rom, after a save to it is written
+    waitForWrites();
     int size = 0;
-    uint8_t* saveData = readFile(glb.savePath, &size);
+    uint8_t* saveData = mapBattery() ? NULL : readFile(glb.savePath, &size);
     if(saveData != NULL) {
       if(snes_loadBattery(glb.snes, saveData, size)) {
         puts("Loaded battery data");
@@ -421,25 +922,28 @@ static void loadRom(const char* path) {
       }
       free(saveData);
     }
+    rewind_reset(glb.rewind);
+    free(glb.runAheadState);
+    glb.runAheadState = malloc(snes_saveState(glb.snes, NULL));
+    if(glb.aheadSnes != NULL) snes_loadRom(glb.aheadSnes, file, length);
+    glb.aheadValid = false;
   } // else, rom load failed, old rom still loaded
 //  free(file); do not free file, it is used by snes_loadRom
 }
 
 static void closeRom() {
   if(!glb.loaded) return;
+  if(glb.batteryMap != NULL) {
+    // the worker syncs and releases the mapping
+    commitBattery();
+    syncBattery(true);
+    return;
+  }
   int size = snes_saveBattery(glb.snes, NULL);
   if(size > 0) {
     uint8_t* saveData = malloc(size);
     snes_saveBattery(glb.snes, saveData);
-    FILE* f = fopen(glb.savePath, "wb");
-    if(f != NULL) {
-      fwrite(saveData, size, 1, f);
-      fclose(f);
-      puts("Saved battery data");
-    } else {
-      puts("Failed to save battery data");
-    }
-    free(saveData);
+    queueWrite(glb.savePath, saveData, size, false, "battery data");
   }
 }
 
@@ -502,3 +1006,215 @@ static uint8_t* readFile(const char* name, int* length) {
   *length = size;
   return buffer;
 }
+
+static mz_bool writeFileData(const void* data, int length, void* user) {
+  return fwrite(data, length, 1, (FILE*) user) == 1;
+}
+
+static bool writeFile(const char* name, const uint8_t* data, int size, bool compress) {
+  FILE* f = fopen(name, "wb");
+  if(f == NULL) return false;
+  bool written = false;
+  if(compress) {
+    // fastest level, streamed to the file as it is compressed
+    uint8_t header[8] = {'L', 'S', 'S', 'Z', size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff, size >> 24};
+    written = fwrite(header, sizeof(header), 1, f) == 1 && tdefl_compress_mem_to_output(
+      data, size, writeFileData, f, tdefl_create_comp_flags_from_zip_params(MZ_BEST_SPEED, MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY)
+    );
+  } else {
+    written = fwrite(data, size, 1, f) == 1;
+  }
+  return fclose(f) == 0 && written;
+}
+
+static uint8_t* readState(const char* name, int* size) {
+  // reads a state file, decompressing it if needed
+  int length = 0;
+  uint8_t* file = readFile(name, &length);
+  if(file == NULL || length < 8 || memcmp(file, "LSSZ", 4) != 0) {
+    *size = length;
+    return file;
+  }
+  uint32_t stateSize = file[4] | (file[5] << 8) | (file[6] << 16) | ((uint32_t) file[7] << 24);
+  // no valid state is larger than the current one, so a damaged header can not ask for a huge buffer
+  uint8_t* state = NULL;
+  if(stateSize > 0 && stateSize <= (uint32_t) snes_saveState(glb.snes, NULL)) state = malloc(stateSize);
+  if(state == NULL) {
+    free(file);
+    return NULL;
+  }
+  size_t done = tinfl_decompress_mem_to_mem(
+    state, stateSize, file + 8, length - 8, TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32
+  );
+  free(file);
+  if(done == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED || done != stateSize) {
+    free(state);
+    return NULL;
+  }
+  *size = stateSize;
+  return state;
+}
+
+static void queueWrite(const char* name, uint8_t* data, int size, bool compress, const char* what) {
+  // hands data (malloc'ed) to the worker, which frees it when written
+  IoJob* job = malloc(sizeof(IoJob));
+  job->next = NULL;
+  job->path = malloc(strlen(name) + 1);
+  strcpy(job->path, name);
+  job->data = data;
+  job->size = size;
+  job->compress = compress;
+  job->what = what;
+  job->map = NULL;
+  job->unmap = false;
+  pushJob(job);
+}
+
+static void pushJob(IoJob* job) {
+  SDL_LockMutex(glb.ioMutex);
+  if(glb.ioLast != NULL) {
+    glb.ioLast->next = job;
+  } else {
+    glb.ioFirst = job;
+  }
+  glb.ioLast = job;
+  glb.ioPending++;
+  SDL_CondBroadcast(glb.ioCond);
+  SDL_UnlockMutex(glb.ioMutex);
+}
+
+static void waitForWrites() {
+  SDL_LockMutex(glb.ioMutex);
+  while(glb.ioPending > 0) SDL_CondWait(glb.ioCond, glb.ioMutex);
+  SDL_UnlockMutex(glb.ioMutex);
+}
+
+static void reportWrite(const SDL_Event* event) {
+  printf("%s %s\n", event->user.code ? "Saved" : "Failed to save", (const char*) event->user.data1);
+}
+
+static int ioThreadMain(void* data) {
+  SDL_LockMutex(glb.ioMutex);
+  while(true) {
+    while(glb.ioFirst == NULL && !glb.ioQuit) SDL_CondWait(glb.ioCond, glb.ioMutex);
+    if(glb.ioFirst == NULL) break; // quits once all is written
+    IoJob* job = glb.ioFirst;
+    glb.ioFirst = job->next;
+    if(glb.ioFirst == NULL) glb.ioLast = NULL;
+    SDL_UnlockMutex(glb.ioMutex);
+    bool written = false;
+    if(job->map != NULL) {
+#ifndef _WIN32
+      written = msync(job->map, job->size, MS_SYNC) == 0;
+      if(job->unmap) munmap(job->map, job->size);
+#endif
+    } else {
+      // a failed or interrupted write leaves the old file as it was
+      char* tempPath = malloc(strlen(job->path) + 5);
+      strcpy(tempPath, job->path);
+      strcat(tempPath, ".tmp");
+      written = writeFile(tempPath, job->data, job->size, job->compress);
+#ifdef _WIN32
+      // rename does not replace existing files here
+      if(written) remove(job->path);
+#endif
+      if(written && rename(tempPath, job->path) != 0) written = false;
+      if(!written) remove(tempPath);
+      free(tempPath);
+    }
+    // the periodic syncs only report failure
+    if(glb.ioEvent != (Uint32) -1 && (job->map == NULL || job->unmap || !written)) {
+      SDL_Event event;
+      SDL_zero(event);
+      event.type = glb.ioEvent;
+      event.user.code = written;
+      event.user.data1 = (void*) job->what;
+      SDL_PushEvent(&event);
+    }
+    free(job->path);
+    free(job->data);
+    free(job);
+    SDL_LockMutex(glb.ioMutex);
+    glb.ioPending--;
+    SDL_CondBroadcast(glb.ioCond);
+  }
+  SDL_UnlockMutex(glb.ioMutex);
+  return 0;
+}
+
+static bool mapBattery() {
+  // maps the save file (created if missing) and loads the battery ram from it, false if the rom has none or
+  // it can not be mapped, it is then read and written as a whole as before
+#ifndef _WIN32
+  int size = snes_saveBattery(glb.snes, NULL);
+  if(size == 0) return false;
+  int fd = open(glb.savePath, O_RDWR | O_CREAT, 0644);
+  if(fd < 0) return false;
+  struct stat info;
+  if(fstat(fd, &info) != 0) info.st_size = -1;
+  uint8_t* map = MAP_FAILED;
+  // a file of another size is left alone, loading it fails
+  if(info.st_size == size || (info.st_size == 0 && ftruncate(fd, size) == 0)) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd); // the mapping keeps the file open
+  if(map == MAP_FAILED) {
+    if(info.st_size == 0) remove(glb.savePath);
+    return false;
+  }
+  // the snes keeps its own copy, speculative frames write to that
+  if(info.st_size == size) {
+    snes_loadBattery(glb.snes, map, size);
+    puts("Loaded battery data");
+  } else {
+    snes_saveBattery(glb.snes, map);
+  }
+  glb.batteryMap = map;
+  glb.batterySize = size;
+  glb.batteryEpoch = snes_newEpoch(glb.snes);
+  glb.batteryWritten = info.st_size != size;
+  glb.batterySyncTime = SDL_GetTicks();
+  return true;
+#else
+  return false;
+#endif
+}
+
+static void commitBattery() {
+  // copies the battery ram pages written since the last call into the mapped save file
+  int size = 0;
+  uint8_t* ram = snes_getArea(glb.snes, SNES_AREA_CARTRAM, &size);
+  uint8_t dirty[0x1000 / 8]; // for up to 1M
+  int pages = snes_getDirtyPages(glb.snes, SNES_AREA_CARTRAM, glb.batteryEpoch, NULL);
+  if(pages > 0x1000) {
+    memcpy(glb.batteryMap, ram, size);
+    glb.batteryWritten = true;
+  } else {
+    snes_getDirtyPages(glb.snes, SNES_AREA_CARTRAM, glb.batteryEpoch, dirty);
+    for(int i = 0; i < pages; i++) {
+      if((dirty[i >> 3] & (1 << (i & 7))) == 0) continue;
+      int offset = i * SNES_PAGE_SIZE;
+      memcpy(glb.batteryMap + offset, ram + offset, size - offset < SNES_PAGE_SIZE ? size - offset : SNES_PAGE_SIZE);
+      glb.batteryWritten = true;
+    }
+  }
+  glb.batteryEpoch = snes_newEpoch(glb.snes);
+}
+
+static void syncBattery(bool unmap) {
+  // has the worker sync the mapped save file if it was copied to (always when unmapping)
+  glb.batterySyncTime = SDL_GetTicks();
+  if(!unmap && !glb.batteryWritten) return;
+  glb.batteryWritten = false;
+  IoJob* job = malloc(sizeof(IoJob));
+  job->next = NULL;
+  job->path = NULL;
+  job->data = NULL;
+  job->size = glb.batterySize;
+  job->compress = false;
+  job->what = "battery data";
+  job->map = glb.batteryMap;
+  job->unmap = unmap;
+  if(unmap) glb.batteryMap = NULL;
+  pushJob(job);
+}
@@ -13,7 +13,6 @@ typedef struct Apu Apu;
 #include "statehandler.h"
 
 typedef struct Timer {
-  uint8_t cycles;
   uint8_t divider;
   uint8_t target;
   uint8_t counter;
@@ -25,19 +24,31 @@ struct Apu {
   Spc* spc;
   Dsp* dsp;
   uint8_t ram[0x10000];
+  uint8_t bootRom[0x40]; // algorithmically constructed (not part of the state)
+  uint32_t pageGenerations[0x100]; // incremented on each write to a ram page
+  uint32_t ramPageEpochs[0x100]; // see snes_getDirtyPages (not part of the state)
   bool romReadable;
+  bool fastIpl; // run the boot rom's upload loops natively, and standard uploads in bulk (not part of the state)
   uint8_t dspAdr;
   uint64_t cycles;
+  SnesClock clock; // apu cycles due at the current master cycle
+  uint64_t dspCycles; // the dsp runs lazily, it has produced all samples due before this cycle
+  uint8_t dspReadPages[0x20]; // bitmaps of ram pages the dsp can read / write before it next catches up
+  uint8_t dspWritePages[0x20];
+  uint64_t timerCycles; // the timers run lazily, they have ticked for all cycles before this one
   uint8_t inPorts[6]; // includes 2 bytes of ram
   uint8_t outPorts[4];
   Timer timer[3];
 };
 
-Apu* apu_init(Snes* snes);
-void apu_free(Apu* apu);
+void apu_init(Apu* apu, Snes* snes);
 void apu_reset(Apu* apu);
 void apu_handleState(Apu* apu, StateHandler* sh);
 void apu_runCycles(Apu* apu);
+void apu_catchupDsp(Apu* apu);
+int apu_startIplReceive(Apu* apu, uint8_t index);
+bool apu_iplReceive(Apu* apu, uint8_t index, uint8_t val);
+int apu_getIplByteCycles(Apu* apu);
 uint8_t apu_read(Apu* apu, uint16_t adr);
 void apu_write(Apu* apu, uint16_t adr, uint8_t val);
 uint8_t apu_spcRead(void* mem, uint16_t adr);
@@ -9,6 +9,7 @@ typedef struct Cart Cart;
 
 #include "snes.h"
 #include "statehandler.h"
+#include "cx4.h"
 
 struct Cart {
   Snes* snes;
@@ -17,13 +18,18 @@ struct Cart {
 
   uint8_t* rom;
   uint32_t romSize;
+  bool romShared; // rom is owned by the instance this one is cloned from
   uint8_t* ram;
   uint32_t ramSize;
+  uint8_t* ramRoom; // space for ram in the instance's block (see snes_init), used if it fits
+  uint32_t ramRoomSize;
+  CX4* cx4; // for type 4, set up by snes_init
+  uint32_t ramPageEpochs[0x200]; // see snes_getDirtyPages, ram beyond 128K counts as always written
 };
 
 // TODO: how to handle reset & load?
 
-Cart* cart_init(Snes* snes);
+void cart_init(Cart* cart, Snes* snes);
 void cart_free(Cart* cart);
 void cart_reset(Cart* cart); // will reset special chips etc, general reading is set up in load
 bool cart_handleTypeState(Cart* cart, StateHandler* sh);
@@ -32,5 +38,6 @@ void cart_load(Cart* cart, int type, uint8_t* rom, int romSize, int ramSize, boo
 bool cart_handleBattery(Cart* cart, bool save, uint8_t* data, int* size); // saves/loads ram
 uint8_t cart_read(Cart* cart, uint8_t bank, uint16_t adr);
 void cart_write(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val);
+uint8_t* cart_getPointer(Cart* cart, uint8_t bank, uint16_t adr, bool write, int* before, int* after); // for dma, block moves
 
 #endif
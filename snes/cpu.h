@@ -10,6 +10,7 @@
 typedef uint8_t (*CpuReadHandler)(void* mem, uint32_t adr);
 typedef void (*CpuWriteHandler)(void* mem, uint32_t adr, uint8_t val);
 typedef void (*CpuIdleHandler)(void* mem, bool waiting);
+typedef int (*CpuBlockMoveHandler)(void* mem, uint32_t code, uint32_t src, uint32_t dest, int step, int count);
 
 typedef struct Cpu Cpu;
 
@@ -19,6 +20,7 @@ struct Cpu {
   CpuReadHandler read;
   CpuWriteHandler write;
   CpuIdleHandler idle;
+  CpuBlockMoveHandler blockMove; // optional, does up to count mvn/mvp iterations at once, returns amount done
   // registers
   uint16_t a;
   uint16_t x;
@@ -49,8 +51,7 @@ struct Cpu {
   bool resetWanted;
 };
 
-Cpu* cpu_init(void* mem, CpuReadHandler read, CpuWriteHandler write, CpuIdleHandler idle);
-void cpu_free(Cpu* cpu);
+void cpu_init(Cpu* cpu, void* mem, CpuReadHandler read, CpuWriteHandler write, CpuIdleHandler idle, CpuBlockMoveHandler blockMove);
 void cpu_reset(Cpu* cpu, bool hard);
 void cpu_handleState(Cpu* cpu, StateHandler* sh);
 void cpu_runOpcode(Cpu* cpu);
@@ -2,11 +2,80 @@
 #ifndef CX4_H
 #define CX4_H
 
-void cx4_init(void *mem);
-uint8_t cx4_read(uint32_t addr);
-void cx4_write(uint32_t addr, uint8_t value);
-void cx4_run();
-void cx4_reset();
-void cx4_handleState(StateHandler* sh);
+#include <stdint.h>
+
+typedef struct CX4 CX4;
+typedef struct CX4Stack CX4Stack;
+
+#include "snes.h"
+#include "statehandler.h"
+
+struct CX4Stack {
+	uint32_t PC;
+	uint32_t PB;
+};
+
+struct CX4 {
+	uint64_t cycles;
+	uint64_t cycles_start;
+	uint64_t suspend_timer;
+	uint32_t running;
+
+	uint32_t prg_base_address;
+	uint16_t prg_startup_bank;
+	uint8_t prg_startup_pc;
+	uint8_t prg_cache_page;
+	uint8_t prg_cache_lock;
+	uint32_t prg_cache[2];
+	uint16_t prg[2][0x100];
+	int32_t prg_cache_timer;
+
+	uint8_t PC;
+	uint16_t PB;
+	uint16_t PB_latch;
+	uint8_t cc;
+	uint32_t A;
+	uint32_t SP;
+	CX4Stack stack[0x08];
+	uint32_t reg[0x10];
+	uint8_t vectors[0x20];
+	uint8_t ram[0x400 * 3];
+
+	uint64_t multiplier;
+
+	// bus
+	uint32_t bus_address;
+	uint32_t bus_mode;
+	uint32_t bus_data;
+	int32_t bus_timer;
+
+	// cpu registers (bus)
+	uint32_t bus_address_pointer;
+	uint32_t ram_address_pointer;
+	uint32_t rom_data;
+	uint32_t ram_data;
+
+	uint8_t irqcfg;
+	uint8_t unkcfg;
+	uint8_t waitstate;
+
+	uint32_t dma_source;
+	uint32_t dma_dest;
+	uint16_t dma_length;
+	int32_t dma_timer;
+
+	// - calculated @ init -
+	int32_t struct_data_length;
+	SnesClock clock;
+	uint64_t sync_to;
+	Snes *snes;
+};
+
+void cx4_init(CX4 *cx4, void *mem);
+uint8_t cx4_read(CX4 *cx4, uint32_t addr);
+void cx4_write(CX4 *cx4, uint32_t addr, uint8_t value);
+void cx4_run(CX4 *cx4);
+void cx4_reset(CX4 *cx4);
+void cx4_handleState(CX4 *cx4, StateHandler* sh);
 
 #endif
@@ -31,16 +31,39 @@ typedef struct DmaChannel {
   bool terminated; // hdma
 } DmaChannel;
 
+#define DMA_HDMA_LINES 16 // hdma lines compiled at once
+#define DMA_HDMA_PAGES 8 // writable pages they can read
+
+// a compiled hdma line of a channel: the values it writes to the b-bus and the channel's state after it
+typedef struct HdmaLine {
+  uint8_t values[4];
+  uint8_t writes;
+  uint8_t repCount;
+  uint16_t tableAdr;
+  uint16_t size;
+  uint8_t lastRead; // open bus after its reads
+  bool doTransfer;
+  bool terminated;
+} HdmaLine;
+
 struct Dma {
   Snes* snes;
   DmaChannel channel[8];
   uint8_t dmaState;
   bool hdmaInitRequested;
   bool hdmaRunRequested;
+  // the next hdma lines, compiled from plain memory (not part of the state, see dma_compileHdma)
+  HdmaLine hdmaLines[8][DMA_HDMA_LINES];
+  uint8_t hdmaLineUnits[DMA_HDMA_LINES]; // 8 cycle steps each line takes
+  uint8_t hdmaLineCount;
+  uint8_t hdmaLinePos;
+  bool hdmaNoCompile; // compiling failed or was undone by a write, until the next frame or register write
+  uint32_t hdmaEpoch; // dirty epoch the lines were compiled in, 0 if they only read rom
+  uint16_t hdmaPages[DMA_HDMA_PAGES]; // the writable pages they read, with bit 15 set for cart ram
+  uint8_t hdmaPageCount;
 };
 
-Dma* dma_init(Snes* snes);
-void dma_free(Dma* dma);
+void dma_init(Dma* dma, Snes* snes);
 void dma_reset(Dma* dma);
 void dma_handleState(Dma* dma, StateHandler* sh);
 uint8_t dma_read(Dma* dma, uint16_t adr); // 43x0-43xf
@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 typedef struct Dsp Dsp;
 
@@ -13,11 +14,8 @@ typedef struct Dsp Dsp;
 typedef struct DspChannel {
   // pitch
   uint16_t pitch;
-  uint16_t pitchCounter;
   bool pitchModulation;
   // brr decoding
-  int16_t decodeBuffer[12];
-  uint8_t bufferOffset;
   uint8_t srcn;
   uint16_t decodeOffset;
   uint8_t blockOffset; // offset within brr block
@@ -34,23 +32,48 @@ typedef struct DspChannel {
   bool directGain;
   uint16_t gainValue; // for direct gain
   uint16_t preclampGain; // for bent increase
-  uint16_t gain;
   // keyon/off
   bool keyOn;
   bool keyOff;
   // output
-  int16_t sampleOut; // final sample, to be multiplied by channel volume
-  int8_t volumeL;
-  int8_t volumeR;
   bool echoEnable;
 } DspChannel;
 
+// per-voice state used by interpolation and mixing, stored per field so that
+// all 8 voices can be processed side by side
+typedef struct DspVoices {
+  int16_t decodeBuffer[12][8]; // [sample][voice]
+  uint16_t pitchCounter[8];
+  uint16_t gain[8];
+  int16_t sampleOut[8]; // final sample, to be multiplied by channel volume
+  int8_t volumeL[8];
+  int8_t volumeR[8];
+  uint8_t bufferOffset[8];
+} DspVoices;
+
+// decoded brr blocks, looked up by address and filter history
+#ifdef TARGET_GNW
+#define DSP_BRR_CACHE_SIZE 32
+#else
+#define DSP_BRR_CACHE_SIZE 512
+#endif
+
+typedef struct DspBrrBlock {
+  uint32_t stamp; // unique per decode, 0 for an empty entry
+  uint32_t pageGenerations[2]; // of the ram pages holding the block, when it was decoded
+  uint16_t adr;
+  int16_t old; // filter history the block was decoded with (0 for unfiltered blocks)
+  int16_t older;
+  int16_t samples[16];
+} DspBrrBlock;
+
 struct Dsp {
   Apu* apu;
   // mirror ram
   uint8_t ram[0x80];
   // 8 channels
   DspChannel channel[8];
+  DspVoices voices;
   // overarching
   uint16_t counter;
   uint16_t dirPage;
@@ -78,23 +101,38 @@ struct Dsp {
   uint16_t echoBufferIndex;
   uint8_t firBufferIndex;
   int8_t firValues[8];
-  int16_t firBufferL[8];
-  int16_t firBufferR[8];
-  // sample ring buffer (2048 samples, *2 for stereo)
+  int16_t firBufferL[16]; // 8 entries, stored twice
+  int16_t firBufferR[16];
+  // sample ring buffer (2048 samples, *2 for stereo), single producer / single consumer: the consumer
+  // (dsp_getSamples or dsp_pullSamples) only reads samples before sampleWritten, and the producer drops
+  // samples while the ring is full. sampleBuffer up to resamplePos is left out of snes_snapshot
   int16_t sampleBuffer[0x800 * 2];
   uint16_t sampleOffset; // current offset in samplebuffer
+  atomic_uint sampleWritten; // sampleOffset as published to the consumer
   uint32_t sampleCount; // samples generated since last render
   uint32_t lastFrameBoundary;
+  atomic_uint resamplePos; // read position of the consumer, 16.16 fixed point
+  bool skipOutput; // generated samples are dropped, for frames that are not heard (not part of the state)
+  // voices that are not released at zero gain, derived from the voice state (not part of the state)
+  uint8_t activeVoices;
+  // brr cache (not part of the state)
+  DspBrrBlock brrCache[DSP_BRR_CACHE_SIZE];
+  uint32_t brrCacheStamp;
+  uint16_t brrCacheEntry[8]; // block each voice is playing from, valid while the stamps match
+  uint32_t brrCacheVoiceStamp[8];
 };
 
-Dsp* dsp_init(Apu* apu);
-void dsp_free(Dsp* dsp);
+void dsp_init(Dsp* dsp, Apu* apu);
 void dsp_reset(Dsp* dsp);
 void dsp_handleState(Dsp* dsp, StateHandler* sh);
 void dsp_cycle(Dsp* dsp);
+void dsp_getRamPages(Dsp* dsp, uint8_t* readPages, uint8_t* writePages);
 uint8_t dsp_read(Dsp* dsp, uint8_t adr);
 void dsp_write(Dsp* dsp, uint8_t adr, uint8_t val);
 void dsp_getSamples(Dsp* dsp, int16_t* sampleData, int samplesPerFrame);
+int dsp_getQueuedSamples(Dsp* dsp);
+void dsp_pullSamples(Dsp* dsp, int16_t* sampleData, int samples, double ratio);
+void dsp_copyOutput(Dsp* dsp, Dsp* src);
 void dsp_newFrame(Dsp* dsp);
 
 #endif
@@ -6,6 +6,9 @@
 
 typedef struct Ppu Ppu;
 
+#define PPU_PALETTE_SLOTS 8 // palettes per frame for indexed output
+#define PPU_LINE_RGB565 0xff // line format for lines rendered as RGB565
+
 #include "snes.h"
 #include "statehandler.h"
 
@@ -39,6 +42,7 @@ struct Ppu {
   Snes* snes;
   // vram access
   uint16_t vram[0x8000];
+  uint32_t vramPageEpochs[0x100]; // per 256 bytes, see snes_getDirtyPages (not part of the state)
   uint16_t vramPointer;
   bool vramIncrementOnHigh;
   uint16_t vramIncrement;
@@ -123,13 +127,30 @@ struct Ppu {
   bool countersLatched;
   uint8_t ppu1openBus;
   uint8_t ppu2openBus;
+  bool skipRender; // lines only evaluate sprites, for frames that are not shown (not part of the state)
+  // the last rendered frame, which the put functions copy out (set at its vblank, not part of the state)
+  bool shownEvenFrame;
+  bool shownOverscan;
+  bool shownInterlace;
+  // rendering caches, per instance (not part of the state)
+  uint32_t brightNow; // brightness lut entry
+  int layerCache[4];
+  uint16_t bgPixelBuf[4];
+  uint8_t bgPrioBuf[4];
+  bool bgWindowState[6]; // 0-3 (bg) 4 (spr) 5 (colorwind)
   // pixel buffer (RGB565)
   // times 2 for even and odd frame
   uint8_t pixelBuffer[256 * 2 * 239 * 2];  // 256 pixels wide, 2 bytes per pixel (RGB565), 239 lines, 2 frames
+  // indexed output: lines that need no color math are stored as 8-bit cgram indices
+  // (first 256 bytes of the line) and converted through a per-frame palette
+  bool indexedOutput;
+  bool paletteDirty; // cgram or brightness changed since the last palette
+  uint8_t paletteCount[2]; // palettes used, per frame
+  uint8_t lineFormat[239 * 2]; // palette slot per line, or PPU_LINE_RGB565
+  uint16_t palettes[2][PPU_PALETTE_SLOTS][256]; // RGB565, brightness applied
 };
 
-Ppu* ppu_init(Snes* snes);
-void ppu_free(Ppu* ppu);
+void ppu_init(Ppu* ppu, Snes* snes);
 void ppu_reset(Ppu* ppu);
 void ppu_handleState(Ppu* ppu, StateHandler* sh);
 bool ppu_checkOverscan(Ppu* ppu);
@@ -138,7 +159,9 @@ void ppu_handleFrameStart(Ppu* ppu);
 void ppu_runLine(Ppu* ppu, int line);
 uint8_t ppu_read(Ppu* ppu, uint8_t adr);
 void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val);
+void ppu_writeBulk(Ppu* ppu, uint8_t adr, bool alternate, const uint8_t* data, int step, int length);
 void ppu_latchHV(Ppu* ppu);
 void ppu_putPixels(Ppu* ppu, uint8_t* pixels);
+void ppu_putPixelsIndexed(Ppu* ppu, uint8_t* pixels, uint16_t* palettes, uint8_t* lineFormats);
 
 #endif
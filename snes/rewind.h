@@ -0,0 +1,50 @@
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Rewind Rewind;
+typedef struct RewindEntry RewindEntry;
+
+#include "snes.h"
+
+struct RewindEntry {
+  int offset; // in buffer
+  int length;
+};
+
+struct Rewind {
+  Snes* snes;
+  // settings
+  int interval; // capture every interval frames
+  int frameCounter;
+  // last captured state, and room for the next one (padded to 8 bytes)
+  int stateSize;
+  int paddedSize;
+  uint8_t* current;
+  uint8_t* next;
+  bool hasCurrent;
+  uint8_t* packed; // encoding scratch
+  // ring of deltas (each turns a state into the one captured before it), newest at the end
+  uint8_t* buffer;
+  int bufferSize;
+  RewindEntry* entries;
+  int maxEntries;
+  int first; // oldest
+  int count;
+  int head; // where the next delta goes in buffer
+  // statistics
+  int usedBytes;
+  uint32_t captures;
+  uint64_t packedBytes; // total for all captures
+};
+
+Rewind* rewind_init(Snes* snes, int budget, int interval);
+void rewind_free(Rewind* rw);
+void rewind_reset(Rewind* rw);
+void rewind_capture(Rewind* rw);
+bool rewind_step(Rewind* rw);
+
+#endif
@@ -4,11 +4,13 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "snes.h"
 #include "cpu.h"
 #include "apu.h"
 #include "spc.h"
+#include "dsp.h"
 #include "dma.h"
 #include "ppu.h"
 #include "cart.h"
@@ -23,46 +25,176 @@ static uint8_t snes_readReg(Snes* snes, uint16_t adr);
 static void snes_writeReg(Snes* snes, uint16_t adr, uint8_t val);
 static uint8_t snes_rread(Snes* snes, uint32_t adr); // wrapped by read, to set open bus
 static int snes_getAccessTime(Snes* snes, uint32_t adr);
-#ifndef TARGET_GNW
-static void build_accesstime(Snes* snes, bool recalc);
-static void free_accesstime();
-
-static uint8_t *access_time;
-#endif
-
-#ifdef TARGET_GNW
-static Snes g_static_snes;
+static void snes_runOpcode(Snes* snes);
+static bool snes_runUpload(Snes* snes);
+
+// an instance and all its parts are a single block, so that it can be copied as a whole (snes_clone,
+// snes_snapshot); the only pointers into it are set (again) by snes_setPointers
+typedef struct SnesArena {
+  Snes snes;
+  Cpu cpu;
+  Apu apu;
+  Spc spc;
+  Dsp dsp;
+  Dma dma;
+  Ppu ppu;
+  Cart cart;
+  CX4 cx4;
+  Input input1;
+  Input input2;
+  uint8_t cartRam[]; // SNES_CART_RAM_ROOM bytes, last so that copies only take what the cart uses
+} SnesArena;
+
+#define SNES_CART_RAM_ROOM 0x20000 // largest sram size in use
+
+// the dsp's audio output ring, which a consumer on another thread (snes_pullSamples) reads and moves through;
+// snapshots leave it out, so that restoring one does not change it under that consumer
+#define SNES_RING_START (offsetof(SnesArena, dsp) + offsetof(Dsp, sampleBuffer))
+#define SNES_RING_END (offsetof(SnesArena, dsp) + offsetof(Dsp, resamplePos) + sizeof(atomic_uint))
+
+static void snes_setPointers(SnesArena* arena);
+static void snes_copyArena(uint8_t* dest, const uint8_t* src, int size);
+
+#if defined(TARGET_GNW) && !defined(LINUX_EMU)
+static SnesArena g_static_arena; // without room for cart ram, cart_load allocates it
 #endif
 
 Snes* snes_init(void) {
-#ifndef TARGET_GNW
-  Snes* snes = malloc(sizeof(Snes));
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
+  SnesArena* arena = malloc(sizeof(SnesArena) + SNES_CART_RAM_ROOM);
 #else
-  Snes* snes = &g_static_snes;
+  SnesArena* arena = &g_static_arena;
 #endif
-  snes->cpu = cpu_init(snes, snes_cpuRead, snes_cpuWrite, snes_cpuIdle);
-  snes->apu = apu_init(snes);
-  snes->dma = dma_init(snes);
-  snes->ppu = ppu_init(snes);
-  snes->cart = cart_init(snes);
-  snes->input1 = input_init(snes);
-  snes->input2 = input_init(snes);
+  Snes* snes = &arena->snes;
+  snes_setPointers(arena);
+  cpu_init(snes->cpu, snes, snes_cpuRead, snes_cpuWrite, snes_cpuIdle, snes_cpuBlockMove);
+  apu_init(snes->apu, snes);
+  dma_init(snes->dma, snes);
+  ppu_init(snes->ppu, snes);
+  cart_init(snes->cart, snes);
+  input_init(snes->input1, snes);
+  input_init(snes->input2, snes);
   snes->palTiming = false;
+  snes->dirtyEpoch = 1;
+  snes->allDirtyEpoch = 1;
+  snes->stateEpoch = 0;
+  memset(snes->ramPageEpochs, 0, sizeof(snes->ramPageEpochs));
+  memset(snes->ppu->vramPageEpochs, 0, sizeof(snes->ppu->vramPageEpochs));
+  memset(snes->apu->ramPageEpochs, 0, sizeof(snes->apu->ramPageEpochs));
+  memset(snes->cart->ramPageEpochs, 0, sizeof(snes->cart->ramPageEpochs));
   return snes;
 }
 
 void snes_free(Snes* snes) {
-#ifndef TARGET_GNW
-  cpu_free(snes->cpu);
-  apu_free(snes->apu);
-  dma_free(snes->dma);
-  ppu_free(snes->ppu);
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
   cart_free(snes->cart);
-  input_free(snes->input1);
-  input_free(snes->input2);
-  free_accesstime();
-  free(snes);
+  free(snes); // the arena
+#else
+  (void) snes;
+#endif
+}
+
+static void snes_setPointers(SnesArena* arena) {
+  Snes* snes = &arena->snes;
+  snes->cpu = &arena->cpu;
+  snes->apu = &arena->apu;
+  snes->dma = &arena->dma;
+  snes->ppu = &arena->ppu;
+  snes->cart = &arena->cart;
+  snes->input1 = &arena->input1;
+  snes->input2 = &arena->input2;
+  arena->cpu.mem = snes;
+  arena->apu.snes = snes;
+  arena->apu.spc = &arena->spc;
+  arena->apu.dsp = &arena->dsp;
+  arena->spc.mem = &arena->apu;
+  arena->dsp.apu = &arena->apu;
+  arena->dma.snes = snes;
+  arena->ppu.snes = snes;
+  arena->cart.snes = snes;
+  arena->cart.cx4 = &arena->cx4;
+  arena->cx4.snes = snes;
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
+  arena->cart.ramRoom = arena->cartRam;
+  arena->cart.ramRoomSize = SNES_CART_RAM_ROOM;
+#else
+  arena->cart.ramRoom = NULL;
+  arena->cart.ramRoomSize = 0;
+#endif
+  arena->input1.snes = snes;
+  arena->input2.snes = snes;
+}
+
+static void snes_copyArena(uint8_t* dest, const uint8_t* src, int size) {
+  // copies an arena (and the cart ram that follows it, within size), except for the output ring
+  memcpy(dest, src, SNES_RING_START);
+  memcpy(dest + SNES_RING_END, src + SNES_RING_END, size - SNES_RING_END);
+}
+
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
+Snes* snes_clone(Snes* snes) {
+  // makes a new instance that is an exact copy of snes, including settings and output buffers; it shares
+  // the rom, so snes has to keep it loaded for as long as the clone exists
+  SnesArena* arena = malloc(sizeof(SnesArena) + SNES_CART_RAM_ROOM);
+  Cart* cart = snes->cart;
+  bool inRoom = cart->ramSize > 0 && cart->ram == cart->ramRoom;
+  snes_copyArena((uint8_t*) arena, (const uint8_t*) snes, sizeof(SnesArena) + (inRoom ? cart->ramSize : 0));
+  snes_setPointers(arena);
+  dsp_copyOutput(&arena->dsp, snes->apu->dsp);
+  Cart* copy = &arena->cart;
+  copy->romShared = true;
+  if(cart->ramSize > 0) {
+    copy->ram = cart->ramSize <= copy->ramRoomSize ? copy->ramRoom : malloc(cart->ramSize);
+    if(!inRoom) memcpy(copy->ram, cart->ram, cart->ramSize);
+  }
+  return &arena->snes;
+}
 #endif
+
+int snes_snapshot(Snes* snes, uint8_t* data) {
+  // copies the whole instance (as snes_clone, but without the audio output ring) to data, which has to
+  // hold snes_snapshot(snes, NULL) bytes; the cart ram goes at the end, so with it in the arena it is copied
+  // along with the rest
+  Cart* cart = snes->cart;
+  int size = sizeof(SnesArena) + cart->ramSize;
+  if(data == NULL) return size;
+  if(cart->ram == cart->ramRoom) {
+    snes_copyArena(data, (const uint8_t*) snes, size);
+  } else {
+    snes_copyArena(data, (const uint8_t*) snes, sizeof(SnesArena));
+    if(cart->ramSize > 0) memcpy(data + sizeof(SnesArena), cart->ram, cart->ramSize);
+  }
+  memset(data + SNES_RING_START, 0, SNES_RING_END - SNES_RING_START);
+  return size;
+}
+
+bool snes_restore(Snes* snes, const uint8_t* data, int size) {
+  // loads a snes_snapshot taken from an instance with the same rom loaded (this one or a clone of it), or
+  // returns false; the rom, the location of the cart ram and the audio output ring stay as they are, so
+  // snes_pullSamples can keep running on another thread, but nothing else may use snes meanwhile
+  Cart* cart = snes->cart;
+  if(size != (int) (sizeof(SnesArena) + cart->ramSize)) return false;
+  Cart saved;
+  memcpy(&saved, data + offsetof(SnesArena, cart), sizeof(Cart));
+  if(saved.type != cart->type || saved.romSize != cart->romSize || saved.ramSize != cart->ramSize) return false;
+  uint8_t* rom = cart->rom;
+  bool romShared = cart->romShared;
+  uint8_t* ram = cart->ram;
+  uint32_t epoch = snes->dirtyEpoch;
+  if(ram == cart->ramRoom) {
+    snes_copyArena((uint8_t*) snes, data, size);
+  } else {
+    snes_copyArena((uint8_t*) snes, data, sizeof(SnesArena));
+    if(cart->ramSize > 0) memcpy(ram, data + sizeof(SnesArena), cart->ramSize);
+  }
+  snes_setPointers((SnesArena*) snes);
+  cart->rom = rom;
+  cart->romShared = romShared;
+  cart->ram = ram;
+  // all of it counts as written, without the epoch going back
+  if(snes->dirtyEpoch < epoch) snes->dirtyEpoch = epoch;
+  snes->allDirtyEpoch = snes->dirtyEpoch;
+  return true;
 }
 
 void snes_reset(Snes* snes, bool hard) {
@@ -90,6 +222,7 @@ void snes_reset(Snes* snes, bool hard) {
   snes->irqCondition = false;
   snes->inIrq = false;
   snes->inVblank = false;
+  snes->vblankEdge = false;
   memset(snes->portAutoRead, 0, sizeof(snes->portAutoRead));
   snes->autoJoyRead = false;
   snes->autoJoyTimer = 0;
@@ -101,9 +234,7 @@ void snes_reset(Snes* snes, bool hard) {
   snes->fastMem = false;
   snes->openBus = 0;
   snes->nextHoriEvent = 16;
-#ifndef TARGET_GNW
-  build_accesstime(snes, false);
-#endif
+  snes->allDirtyEpoch = snes->dirtyEpoch;
 }
 
 void snes_handleState(Snes* snes, StateHandler* sh) {
@@ -131,15 +262,27 @@ void snes_handleState(Snes* snes, StateHandler* sh) {
 }
 
 void snes_runFrame(Snes* snes) {
+  snes->apuPortPolled = false; // not part of the state, so frames run the same after loading one
   while(snes->inVblank) {
-    cpu_runOpcode(snes->cpu);
+    snes->vblankEdge = false;
+    snes_runOpcode(snes);
   }
   uint32_t frame = snes->frames;
   while(!snes->inVblank && frame == snes->frames) {
-    cpu_runOpcode(snes->cpu);
+    snes->vblankEdge = false;
+    snes_runOpcode(snes);
   }
 }
 
+static void snes_runOpcode(Snes* snes) {
+  // an opcode that polled apu port 0 might have been the wait loop of an upload, which can be taken in bulk
+  if(snes->apuPortPolled) {
+    snes->apuPortPolled = false;
+    if(snes_runUpload(snes)) return;
+  }
+  cpu_runOpcode(snes->cpu);
+}
+
 void snes_runCycles(Snes* snes, int cycles) {
   if(snes->hPos + cycles >= 536 && snes->hPos < 536) {
     // if we go past 536, add 40 cycles for dram refersh
@@ -161,6 +304,31 @@ void snes_syncCycles(Snes* snes, bool start, int syncCycles) {
   }
 }
 
+int snes_getIdleCycles(Snes* snes) {
+  // amount of cycles that can be run (in steps of 8) without reaching an event, refresh or irq check that matters
+  if(snes->hvTimer > 0) return 0;
+  int limit = snes->nextHoriEvent;
+  if(snes->hPos < 536 && limit > 536) limit = 536;
+  if(snes->hIrqEnabled) {
+    if((snes->vPos == snes->vTimer || !snes->vIrqEnabled) && snes->hPos <= snes->hTimer && snes->hTimer < limit) {
+      limit = snes->hTimer + 2;
+    }
+  } else if(snes->vIrqEnabled && snes->vPos == snes->vTimer && !snes->irqCondition) {
+    return 0;
+  }
+  int cycles = limit - snes->hPos - 2;
+  return cycles > 0 ? cycles : 0;
+}
+
+void snes_skipCycles(Snes* snes, int cycles) {
+  // same as snes_runCycles, for spans within the idle cycles
+  snes->cycles += cycles;
+  snes->hPos += cycles;
+  // with h-irq enabled the span ends before the h-timer, so the condition is only met for v-irq
+  snes->irqCondition = snes->vIrqEnabled && !snes->hIrqEnabled && snes->vPos == snes->vTimer;
+  snes->autoJoyTimer = snes->autoJoyTimer > cycles ? snes->autoJoyTimer - cycles : 0;
+}
+
 static void snes_runCycle(Snes* snes) {
   snes->cycles += 2;
   if ((snes->hPos & 2) == 0) {
@@ -219,14 +387,14 @@ static void snes_runCycle(Snes* snes) {
         if(!snes->palTiming) {
           // even interlace frame is 263 lines
           if((snes->vPos == 262 && (!snes->ppu->frameInterlace || !snes->ppu->evenFrame)) || snes->vPos == 263) {
-            if (snes->cart->type == 4) cx4_run();
+            if (snes->cart->type == 4) cx4_run(snes->cart->cx4);
             snes->vPos = 0;
             snes->frames++;
           }
 	    } else {
           // even interlace frame is 313 lines
           if((snes->vPos == 312 && (!snes->ppu->frameInterlace || !snes->ppu->evenFrame)) || snes->vPos == 313) {
-            if (snes->cart->type == 4) cx4_run();
+            if (snes->cart->type == 4) cx4_run(snes->cart->cx4);
             snes->vPos = 0;
             snes->frames++;
           }
@@ -237,6 +405,7 @@ static void snes_runCycle(Snes* snes) {
         if(snes->vPos == 0) {
           // end of vblank
           snes->inVblank = false;
+          snes->vblankEdge = true;
           snes->inNmi = false;
           ppu_handleFrameStart(snes->ppu);
         } else if(snes->vPos == 225) {
@@ -249,12 +418,14 @@ static void snes_runCycle(Snes* snes) {
         if(startingVblank) {
           // catch up the apu at end of emulated frame (we end frame @ start of vblank)
           snes_catchupApu(snes);
+          apu_catchupDsp(snes->apu);
           // notify dsp of frame-end, because sometimes dma will extend much further past vblank (or even into the next frame)
           // Megaman X2 (titlescreen animation), Tales of Phantasia (game demo), Actraiser 2 (fade-in @ bootup)
 		  dsp_newFrame(snes->apu->dsp);
           // we are starting vblank
           ppu_handleVblank(snes->ppu);
           snes->inVblank = true;
+          snes->vblankEdge = true;
           snes->inNmi = true;
           if(snes->autoJoyRead) {
             // TODO: this starts a little after start of vblank
@@ -276,6 +447,31 @@ static void snes_catchupApu(Snes* snes) {
   apu_runCycles(snes->apu);
 }
 
+uint64_t snes_convertCycles(SnesClock* clock, uint64_t master, uint32_t num, uint32_t den) {
+  if(master < clock->master || num != clock->num || den != clock->den) {
+    // start over from cycle 0 (after a reset, state load or region change)
+    clock->master = 0;
+    clock->cycles = 0;
+    clock->remainder = 0;
+    clock->num = num;
+    clock->den = den;
+    clock->fastLimit = (UINT32_MAX - den) / num;
+  }
+  uint64_t delta = master - clock->master;
+  clock->master = master;
+  if(delta <= clock->fastLimit) {
+    // usual case, only 32-bit multiply and divide
+    uint32_t product = (uint32_t) delta * num + clock->remainder;
+    clock->cycles += product / den;
+    clock->remainder = product % den;
+  } else {
+    uint64_t product = (delta % den) * num + clock->remainder;
+    clock->cycles += (delta / den) * num + product / den;
+    clock->remainder = product % den;
+  }
+  return clock->cycles;
+}
+
 static void snes_doAutoJoypad(Snes* snes) {
   memset(snes->portAutoRead, 0, sizeof(snes->portAutoRead));
   // latch controllers
@@ -299,6 +495,7 @@ uint8_t snes_readBBus(Snes* snes, uint8_t adr) {
   }
   if(adr < 0x80) {
     snes_catchupApu(snes); // catch up the apu before reading
+    if((adr & 0x3) == 0) snes->apuPortPolled = true;
     return snes->apu->outPorts[adr & 0x3];
   }
   if(adr == 0x80) {
@@ -321,6 +518,7 @@ void snes_writeBBus(Snes* snes, uint8_t adr, uint8_t val) {
   }
   switch(adr) {
     case 0x80: {
+      snes->ramPageEpochs[snes->ramAdr >> 8] = snes->dirtyEpoch;
       snes->ram[snes->ramAdr++] = val;
       snes->ramAdr &= 0x1ffff;
       break;
@@ -471,12 +669,7 @@ static void snes_writeReg(Snes* snes, uint16_t adr, uint8_t val) {
       break;
     }
     case 0x420d: {
-      if (snes->fastMem != (val & 0x1)) {
-        snes->fastMem = val & 0x1;
-#ifndef TARGET_GNW
-        build_accesstime(snes, true);
-#endif
-      }
+      snes->fastMem = val & 0x1;
       break;
     }
     default: {
@@ -521,10 +714,12 @@ void snes_write(Snes* snes, uint32_t adr, uint8_t val) {
   adr &= 0xffff;
   if(bank == 0x7e || bank == 0x7f) {
     snes->ram[((bank & 1) << 16) | adr] = val; // ram
+    snes->ramPageEpochs[((bank & 1) << 8) | (adr >> 8)] = snes->dirtyEpoch;
   }
   if(bank < 0x40 || (bank >= 0x80 && bank < 0xc0)) {
     if(adr < 0x2000) {
       snes->ram[adr] = val; // ram mirror
+      snes->ramPageEpochs[adr >> 8] = snes->dirtyEpoch;
     }
     if(adr >= 0x2100 && adr < 0x2200) {
       snes_writeBBus(snes, adr & 0xff, val); // B-bus
@@ -557,28 +752,32 @@ static int snes_getAccessTime(Snes* snes, uint32_t adr) {
   return (snes->fastMem && bank >= 0x80) ? 6 : 8; // depends on setting in banks 80+
 }
 
-#ifndef TARGET_GNW
-static void build_accesstime(Snes* snes, bool recalc) {
-  int start = (recalc) ? 0x800000 : 0; // recalc only updates "fastMem" area
-  if (access_time == NULL) {
-	access_time = (uint8_t *)malloc(0x1000000);
-  }
-  for (int i = start; i < 0x1000000; i++) {
-    access_time[i] = snes_getAccessTime(snes, i);
-  }
-}
-
-static void free_accesstime() {
-  free(access_time);
-}
-#endif
-
 uint8_t snes_read(Snes* snes, uint32_t adr) {
   uint8_t val = snes_rread(snes, adr);
   snes->openBus = val;
   return val;
 }
 
+uint8_t* snes_getPointer(Snes* snes, uint32_t adr, bool write, int* before, int* after) {
+  // returns a pointer if adr is plain memory (wram, sram or rom for reading), see cart_getPointer
+  uint8_t bank = adr >> 16;
+  adr &= 0xffff;
+  if(bank == 0x7e || bank == 0x7f) {
+    if(before != NULL) *before = adr;
+    *after = 0x10000 - adr;
+    return &snes->ram[((bank & 1) << 16) | adr];
+  }
+  if(bank < 0x40 || (bank >= 0x80 && bank < 0xc0)) {
+    if(adr < 0x2000) {
+      if(before != NULL) *before = adr;
+      *after = 0x2000 - adr;
+      return &snes->ram[adr];
+    }
+    if(adr < 0x6000) return NULL; // b-bus, registers
+  }
+  return cart_getPointer(snes->cart, bank, adr, write, before, after);
+}
+
 void snes_cpuIdle(void* mem, bool waiting) {
   Snes* snes = (Snes*) mem;
   dma_handleDma(snes->dma, 6);
@@ -603,6 +802,137 @@ void snes_cpuWrite(void* mem, uint32_t adr, uint8_t val) {
   snes_write(snes, adr, val);
 }
 
+int snes_cpuBlockMove(void* mem, uint32_t code, uint32_t src, uint32_t dest, int step, int count) {
+  Snes* snes = (Snes*) mem;
+  // does up to count iterations of mvn/mvp (opcode at code) at once, as long as it can not be told apart from
+  // running them one by one: only plain memory, no dma pending and no event, irq or refresh within the span
+  // the frame ends after the opcode that reached the vblank edge, so that one can not continue
+  if(snes->vblankEdge || snes->dma->dmaState != 0 || snes->dma->hdmaInitRequested || snes->dma->hdmaRunRequested) return 0;
+  int codeAfter = 0, srcBefore = 0, srcAfter = 0, destBefore = 0, destAfter = 0;
+  uint8_t* codePtr = snes_getPointer(snes, code, false, NULL, &codeAfter);
+  uint8_t* srcPtr = snes_getPointer(snes, src, false, &srcBefore, &srcAfter);
+  uint8_t* destPtr = snes_getPointer(snes, dest, true, &destBefore, &destAfter);
+  if(codePtr == NULL || codeAfter < 3 || srcPtr == NULL || destPtr == NULL) return 0;
+  if(step > 0) {
+    if(srcAfter < count) count = srcAfter;
+    if(destAfter < count) count = destAfter;
+  } else {
+    if(srcBefore + 1 < count) count = srcBefore + 1;
+    if(destBefore + 1 < count) count = destBefore + 1;
+  }
+  // the opcode itself can not be overwritten
+  uint8_t* destLow = step > 0 ? destPtr : destPtr - (count - 1);
+  if(destLow < codePtr + 3 && codePtr < destLow + count) return 0;
+  // opcode and operands, read, write and 2 idle cycles (access time is the same throughout each area)
+  int cycles = 3 * snes_getAccessTime(snes, code) + snes_getAccessTime(snes, src) + snes_getAccessTime(snes, dest) + 12;
+  int fits = snes_getIdleCycles(snes) / cycles;
+  if(fits < count) count = fits;
+  if(count <= 0) return 0;
+  snes_skipCycles(snes, count * cycles);
+  for(int i = 0; i < count; i++) {
+    destPtr[i * step] = srcPtr[i * step];
+  }
+  snes_markWritten(snes, destLow, count);
+  snes->openBus = destPtr[(count - 1) * step];
+  return count;
+}
+
+// the upload loop from the developer manual, which most games use (the direct page operand varies):
+// loop: xba / lda [dp],y / iny / xba / wait: cmp $2140 / bne wait / inc a / rep #$20 / sta $2140 / sep #$20 /
+// dex / bne loop
+static const uint8_t uploadLoop[21] = {
+  0xeb, 0xb7, 0x00, 0xc8, 0xeb, 0xcd, 0x40, 0x21, 0xd0, 0xfb, 0x1a, 0xc2, 0x20, 0x8d, 0x40, 0x21, 0xe2, 0x20,
+  0xca, 0xd0, 0xeb
+};
+
+static bool snes_runUpload(Snes* snes) {
+  // high level emulation of the upload loop, between opcodes, once its wait loop saw a byte acknowledged
+  // (at the bne after cmp $2140): while the apu is in the boot rom's receive loop, the following bytes go
+  // straight into aram and both clocks advance by the nominal time per byte (that of the slower loop, in
+  // which events still run). stops at an interrupt, the vblank edge or the end of a page, and
+  // leaves the last byte of the block and anything that does not match to the interpreter
+  Cpu* cpu = snes->cpu;
+  if(!snes->apu->fastIpl || cpu->e || !cpu->mf || !cpu->z || cpu->intWanted || (cpu->db & 0x40)) return false;
+  // an h-irq would be taken while the cpu waits, not after each byte
+  if(snes->hIrqEnabled && !cpu->i) return false;
+  if(snes->vblankEdge || snes->dma->dmaState != 0 || snes->dma->hdmaInitRequested || snes->dma->hdmaRunRequested) return false;
+  uint32_t code = (cpu->k << 16) | ((cpu->pc - 8) & 0xffff);
+  int codeAfter = 0, dpAfter = 0, srcAfter = 0;
+  uint8_t* codePtr = snes_getPointer(snes, code, false, NULL, &codeAfter);
+  if(codePtr == NULL || codeAfter < 21) return false;
+  for(int i = 0; i < 21; i++) {
+    if(i != 2 && codePtr[i] != uploadLoop[i]) return false;
+  }
+  uint16_t dpAdr = cpu->dp + codePtr[2];
+  uint8_t* dpPtr = snes_getPointer(snes, dpAdr, false, NULL, &dpAfter);
+  if(dpPtr == NULL || dpAfter < 3) return false;
+  uint32_t src = ((dpPtr[0] | (dpPtr[1] << 8) | (dpPtr[2] << 16)) + cpu->y) & 0xffffff;
+  uint8_t* srcPtr = snes_getPointer(snes, src, false, NULL, &srcAfter);
+  if(srcPtr == NULL) return false;
+  // bytes left for the loop (but its last), without y wrapping, from plain memory
+  int count = (cpu->xf ? cpu->x & 0xff : cpu->x) - 1;
+  int yRoom = (cpu->xf ? 0xff : 0xffff) - cpu->y;
+  if(yRoom < count) count = yRoom;
+  if(srcAfter < count) count = srcAfter;
+  if(count <= 0) return false;
+  uint8_t index = cpu->a & 0xff;
+  snes_catchupApu(snes);
+  int room = apu_startIplReceive(snes->apu, index);
+  if(room < count) count = room;
+  if(count <= 0) return false;
+  // 21 opcode and operand fetches, 3 pointer reads, the data read, 3 port accesses and 10 idle cycles (11 for
+  // an unaligned direct page)
+  int loopCycles = 21 * snes_getAccessTime(snes, code) + 3 * snes_getAccessTime(snes, dpAdr) + snes_getAccessTime(snes, src);
+  loopCycles += 18 + ((cpu->dp & 0xff) != 0 ? 66 : 60);
+  int period = apu_getIplByteCycles(snes->apu);
+  if(loopCycles > period) period = loopCycles;
+  uint8_t val = cpu->a >> 8;
+  int done = 0;
+  while(done < count && apu_iplReceive(snes->apu, index + 1 + done, val)) {
+    val = srcPtr[done++];
+    if(period <= snes_getIdleCycles(snes)) {
+      snes_skipCycles(snes, period);
+    } else {
+      // events, hdma and the dram refresh as they happen while the cpu polls port 0, which only takes
+      // from its wait for the apu
+      uint64_t end = snes->cycles + period;
+      while(snes->cycles < end) {
+        int cycles = end - snes->cycles < 6 ? end - snes->cycles : 6;
+        dma_handleDma(snes->dma, cycles);
+        snes_runCycles(snes, cycles);
+      }
+    }
+    if(snes->vblankEdge || cpu->nmiWanted || (cpu->irqWanted && !cpu->i)) break;
+  }
+  if(done == 0) return false;
+  // back at the bne, with the last byte sent acknowledged and the next one loaded
+  index += done;
+  cpu->a = (val << 8) | index;
+  cpu->x -= done;
+  cpu->y += done;
+  cpu->c = true;
+  cpu->n = false;
+  snes->openBus = index;
+  return true;
+}
+
+void snes_markWritten(Snes* snes, const uint8_t* ptr, int length) {
+  // stamps the pages of a bulk write into wram or cart ram (as returned by snes_getPointer)
+  uint32_t* epochs = NULL;
+  int start = 0;
+  if(ptr >= snes->ram && ptr < snes->ram + sizeof(snes->ram)) {
+    epochs = snes->ramPageEpochs;
+    start = ptr - snes->ram;
+  } else if(snes->cart->ram != NULL && ptr >= snes->cart->ram && ptr < snes->cart->ram + snes->cart->ramSize) {
+    epochs = snes->cart->ramPageEpochs;
+    start = ptr - snes->cart->ram;
+  }
+  if(epochs == NULL || length <= 0) return;
+  for(int page = start >> 8; page <= (start + length - 1) >> 8 && page < 0x200; page++) {
+    epochs[page] = snes->dirtyEpoch;
+  }
+}
+
 // debugging
 
 void snes_runCpuCycle(Snes* snes) {
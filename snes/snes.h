@@ -7,6 +7,27 @@
 
 typedef struct Snes Snes;
 
+// nominal rate of the generated audio (about 534 samples per ntsc frame)
+#define SNES_SAMPLE_RATE 32040
+
+// memory areas with dirty page tracking, and their page size
+#define SNES_AREA_WRAM 0
+#define SNES_AREA_VRAM 1
+#define SNES_AREA_ARAM 2
+#define SNES_AREA_CARTRAM 3
+#define SNES_PAGE_SIZE 0x100
+
+// converts master cycles to the cycles of another clock (num / den of the master clock) without
+// rounding drift, by carrying the remainder from call to call
+typedef struct SnesClock {
+  uint64_t master; // master cycle of the last conversion
+  uint64_t cycles; // floor(master * num / den)
+  uint32_t remainder; // (master * num) % den
+  uint32_t num;
+  uint32_t den;
+  uint32_t fastLimit; // master cycle steps for which the product fits in 32 bits
+} SnesClock;
+
 #include "cpu.h"
 #include "apu.h"
 #include "dma.h"
@@ -29,6 +50,12 @@ struct Snes {
   uint8_t ram[0x20000];
   uint32_t ramAdr;
   uint8_t ramFill;
+  // dirty page tracking (not part of the state): wram, vram, aram and cart ram keep the epoch of the
+  // last write to each of their pages, see snes_getDirtyPages
+  uint32_t dirtyEpoch;
+  uint32_t allDirtyEpoch; // every page counts as written in this one (reset, loading a rom or battery)
+  uint32_t stateEpoch; // same, except for cart ram, of which only changed pages count (loading a state)
+  uint32_t ramPageEpochs[0x200];
   // frame timing
   uint16_t hPos;
   uint16_t vPos;
@@ -48,6 +75,8 @@ struct Snes {
   bool irqCondition;
   bool inIrq;
   bool inVblank;
+  bool vblankEdge; // vblank started or ended during the current opcode (ends snes_runFrame)
+  bool apuPortPolled; // the current opcode read apu port 0 (see snes_runUpload, not part of the state)
   // joypad handling
   uint16_t portAutoRead[4]; // as read by auto-joypad read
   bool autoJoyRead;
@@ -65,19 +94,29 @@ struct Snes {
 
 Snes* snes_init(void);
 void snes_free(Snes* snes);
+Snes* snes_clone(Snes* snes);
+int snes_snapshot(Snes* snes, uint8_t* data);
+bool snes_restore(Snes* snes, const uint8_t* data, int size);
 void snes_reset(Snes* snes, bool hard);
 void snes_handleState(Snes* snes, StateHandler* sh);
 void snes_runFrame(Snes* snes);
+// used by apu, cx4
+uint64_t snes_convertCycles(SnesClock* clock, uint64_t master, uint32_t num, uint32_t den);
 // used by dma, cpu
 void snes_runCycles(Snes* snes, int cycles);
 void snes_syncCycles(Snes* snes, bool start, int syncCycles);
+int snes_getIdleCycles(Snes* snes);
+void snes_skipCycles(Snes* snes, int cycles);
 uint8_t snes_readBBus(Snes* snes, uint8_t adr);
 void snes_writeBBus(Snes* snes, uint8_t adr, uint8_t val);
 uint8_t snes_read(Snes* snes, uint32_t adr);
 void snes_write(Snes* snes, uint32_t adr, uint8_t val);
+uint8_t* snes_getPointer(Snes* snes, uint32_t adr, bool write, int* before, int* after);
+void snes_markWritten(Snes* snes, const uint8_t* ptr, int length);
 void snes_cpuIdle(void* mem, bool waiting);
 uint8_t snes_cpuRead(void* mem, uint32_t adr);
 void snes_cpuWrite(void* mem, uint32_t adr, uint8_t val);
+int snes_cpuBlockMove(void* mem, uint32_t code, uint32_t src, uint32_t dest, int step, int count);
 // debugging
 void snes_runCpuCycle(Snes* snes);
 void snes_runSpcCycle(Snes* snes);
@@ -87,10 +126,19 @@ void snes_runSpcCycle(Snes* snes);
 bool snes_loadRom(Snes* snes, const uint8_t* data, int length);
 void snes_setButtonState(Snes* snes, int player, int button, bool pressed);
 void snes_setPixels(Snes* snes, uint8_t* pixelData);
+void snes_setIndexedOutput(Snes* snes, bool enabled);
+void snes_setPixelsIndexed(Snes* snes, uint8_t* pixelData, uint16_t* paletteData, uint8_t* lineData);
+void snes_setFastIpl(Snes* snes, bool enabled);
 void snes_setSamples(Snes* snes, int16_t* sampleData, int samplesPerFrame);
+int snes_getQueuedSamples(Snes* snes);
+void snes_pullSamples(Snes* snes, int16_t* sampleData, int samples, double ratio);
 int snes_saveBattery(Snes* snes, uint8_t* data);
 bool snes_loadBattery(Snes* snes, uint8_t* data, int size);
 int snes_saveState(Snes* snes, uint8_t* data);
 bool snes_loadState(Snes* snes, uint8_t* data, int size);
+void snes_runFrameAhead(Snes* snes, int frames, uint8_t* stateData);
+uint32_t snes_newEpoch(Snes* snes);
+uint8_t* snes_getArea(Snes* snes, int area, int* size);
+int snes_getDirtyPages(Snes* snes, int area, uint32_t since, uint8_t* bitmap);
 
 #endif
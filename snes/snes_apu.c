@@ -11,12 +11,6 @@
 #include "dsp.h"
 #include "statehandler.h"
 
-#ifdef TARGET_GNW
-static Apu g_static_apu;
-#endif
-
-static uint8_t bootRom[0x40]; // algorithmically constructed
-
 static const uint8_t iplDeltas[0x40] = {
   0x18, 0x45, 0xeb, 0x61, 0x1c, 0x9a, 0xdc, 0x06, 0xa1, 0x26, 0x15, 0x07, 0x89, 0x96, 0xb8, 0xe2,
   0xf5, 0xe1, 0x1e, 0xf1, 0xeb, 0x0a, 0xd2, 0xc0, 0xf7, 0x83, 0x7e, 0x60, 0x93, 0x40, 0x15, 0x46,
@@ -24,10 +18,15 @@ static const uint8_t iplDeltas[0x40] = {
   0xdc, 0xa2, 0x2f, 0xd7, 0xa6, 0x06, 0xd3, 0x84, 0xc4, 0xdc, 0xb8, 0x7f, 0x02, 0x86, 0x47, 0x6a,
 };
 
-static const double apuCyclesPerMaster = (32040 * 32) / (1364 * 262 * 60.0);
-static const double apuCyclesPerMasterPal = (32040 * 32) / (1364 * 312 * 50.0);
+// apu cycles per master cycle, (32040 * 32) / (1364 * 262 * 60) and (32040 * 32) / (1364 * 312 * 50) reduced
+static const uint32_t apuClockNum = 2136, apuClockDen = 44671;
+static const uint32_t apuClockNumPal = 1068, apuClockDenPal = 22165;
 
 static void apu_cycle(Apu* apu);
+static void apu_updateDspPages(Apu* apu);
+static void apu_catchupTimers(Apu* apu);
+static bool apu_runIpl(Apu* apu, uint64_t syncTo);
+static void apu_skipCycles(Apu* apu, uint64_t cycles);
 
 static uint8_t ipl_lfsr(uint32_t posTo, int32_t arrayPos) {
   uint32_t seed = 0xa5; // it's magic! (tm)
@@ -40,7 +39,7 @@ static uint8_t ipl_lfsr(uint32_t posTo, int32_t arrayPos) {
   return seed;
 }
 
-static void ipl_create() {
+static void ipl_create(uint8_t* bootRom) {
   uint8_t prev = 0;
   for (int i = 0; i < 0x40; i++) {
     prev = (prev - iplDeltas[i]) & 0xff;
@@ -49,47 +48,43 @@ static void ipl_create() {
   }
 }
 
-Apu* apu_init(Snes* snes) {
-#ifndef TARGET_GNW
-  Apu* apu = malloc(sizeof(Apu));
-#else
-  Apu* apu = &g_static_apu;
-#endif
+void apu_init(Apu* apu, Snes* snes) {
+  // apu->spc and apu->dsp are set up by snes_init
   apu->snes = snes;
-  apu->spc = spc_init(apu, apu_spcRead, apu_spcWrite, apu_spcIdle);
-  apu->dsp = dsp_init(apu);
-  ipl_create();
-  return apu;
+  spc_init(apu->spc, apu, apu_spcRead, apu_spcWrite, apu_spcIdle);
+  dsp_init(apu->dsp, apu);
+  apu->fastIpl = true;
+  ipl_create(apu->bootRom);
 }
 
-#ifndef TARGET_GNW
-void apu_free(Apu* apu) {
-  spc_free(apu->spc);
-  dsp_free(apu->dsp);
-  free(apu);
-}
-#endif
-
 void apu_reset(Apu* apu) {
   // TODO: hard reset for apu
   spc_reset(apu->spc, true);
   dsp_reset(apu->dsp);
   memset(apu->ram, 0, sizeof(apu->ram));
+  memset(apu->pageGenerations, 0, sizeof(apu->pageGenerations));
   apu->dspAdr = 0;
   apu->romReadable = true;
   apu->cycles = 0;
+  memset(&apu->clock, 0, sizeof(apu->clock));
+  apu->dspCycles = 0;
+  apu->timerCycles = 0;
   memset(apu->inPorts, 0, sizeof(apu->inPorts));
   memset(apu->outPorts, 0, sizeof(apu->outPorts));
   for(int i = 0; i < 3; i++) {
-    apu->timer[i].cycles = 0;
     apu->timer[i].divider = 0;
     apu->timer[i].target = 0;
     apu->timer[i].counter = 0;
     apu->timer[i].enabled = false;
   }
+  apu_catchupDsp(apu);
 }
 
 void apu_handleState(Apu* apu, StateHandler* sh) {
+  if(sh->saving) {
+    apu_catchupDsp(apu);
+    apu_catchupTimers(apu);
+  }
   sh_handleBools(sh, &apu->romReadable, NULL);
   sh_handleBytes(sh,
     &apu->dspAdr, &apu->inPorts[0], &apu->inPorts[1], &apu->inPorts[2], &apu->inPorts[3], &apu->inPorts[4],
@@ -97,49 +92,213 @@ void apu_handleState(Apu* apu, StateHandler* sh) {
   );
   sh_handleLongLongs(sh, &apu->cycles, NULL);
   for(int i = 0; i < 3; i++) {
+    // cycles until the next timer stage tick, follows from the apu cycle count
+    uint8_t timerCycles = -apu->cycles & (i == 2 ? 15 : 127);
     sh_handleBools(sh, &apu->timer[i].enabled, NULL);
-    sh_handleBytes(sh, &apu->timer[i].cycles, &apu->timer[i].divider, &apu->timer[i].target, &apu->timer[i].counter, NULL);
+    sh_handleBytes(sh, &timerCycles, &apu->timer[i].divider, &apu->timer[i].target, &apu->timer[i].counter, NULL);
   }
   sh_handleByteArray(sh, apu->ram, 0x10000);
   // components
   spc_handleState(apu->spc, sh);
   dsp_handleState(apu->dsp, sh);
+  if(!sh->saving) {
+    apu->dspCycles = apu->cycles;
+    apu->timerCycles = apu->cycles;
+    apu_catchupDsp(apu);
+  }
 }
 
 void apu_runCycles(Apu* apu) {
-  uint64_t sync_to = (uint64_t)apu->snes->cycles * (apu->snes->palTiming ? apuCyclesPerMasterPal : apuCyclesPerMaster);
+  uint64_t sync_to = apu->snes->palTiming ?
+    snes_convertCycles(&apu->clock, apu->snes->cycles, apuClockNumPal, apuClockDenPal) :
+    snes_convertCycles(&apu->clock, apu->snes->cycles, apuClockNum, apuClockDen);
 
   while (apu->cycles < sync_to) {
+    if(apu->spc->pc >= 0xffc0 && apu_runIpl(apu, sync_to)) continue;
     spc_runOpcode(apu->spc);
   }
 }
 
-static void apu_cycle(Apu* apu) {
-  if((apu->cycles & 0x1f) == 0) {
-    // every 32 cycles
+static bool apu_runIpl(Apu* apu, uint64_t syncTo) {
+  // fast path for the boot rom's upload protocol: its loops either wait for a port value (and the
+  // ports cannot change before syncTo) or receive a single byte; these are run without the
+  // interpreter, with the same accesses on the same cycles. returns false to interpret instead
+  Spc* spc = apu->spc;
+  if(!apu->fastIpl || !apu->romReadable || spc->step != 0 || spc->p || spc->resetWanted || spc->stopped) return false;
+  uint64_t left = syncTo - apu->cycles;
+  uint8_t port = apu->inPorts[0];
+  switch(spc->pc) {
+    case 0xffcf: { // cmp $f4,#$cc / bne $ffcf: wait for the start of the transfer (9 cycles)
+      if(port == 0xcc || left < 9) return false;
+      apu_skipCycles(apu, left - left % 9);
+      spc->c = port >= 0xcc;
+      spc->z = false;
+      spc->n = (port - 0xcc) & 0x80;
+      spc->opcode = 0xd0;
+      spc->dat = 0xfb;
+      return true;
+    }
+    case 0xffd6: { // mov y,$f4 / bne $ffd6: wait for port 0 to be 0 (7 cycles)
+      if(port == 0 || left < 7) return false;
+      apu_skipCycles(apu, left - left % 7);
+      spc->y = port;
+      spc->z = false;
+      spc->n = port & 0x80;
+      spc->adr = 0xf4;
+      spc->opcode = 0xd0;
+      spc->dat = 0xfc;
+      return true;
+    }
+    case 0xffda: {
+      if(port != spc->y) {
+        // cmp y,$f4 / bne $ffe9 / bpl $ffda: wait for the next index (11 cycles)
+        if(((spc->y - port) & 0x80) || left < 11) return false;
+        apu_skipCycles(apu, left - left % 11);
+        spc->c = spc->y >= port;
+        spc->z = false;
+        spc->n = false;
+        spc->adr = 0xf4;
+        spc->opcode = 0x10;
+        spc->dat = 0xef;
+        return true;
+      }
+      // cmp y,$f4 / bne $ffe9 / mov a,$f5 / mov $f4,y / mov [$00]+y,a / inc y / bne $ffda: receive a
+      // byte (25 cycles); the last byte of a page and stores to the io registers are interpreted
+      uint16_t adr = ((apu->ram[0] | (apu->ram[1] << 8)) + spc->y) & 0xffff;
+      if(spc->y == 0xff || (adr & 0xfff0) == 0xf0 || left < 25) return false;
+      spc->c = true;
+      apu_skipCycles(apu, 7);
+      spc->a = apu_spcRead(apu, 0xf5);
+      apu_skipCycles(apu, 3);
+      apu_spcWrite(apu, 0xf4, spc->y);
+      apu_skipCycles(apu, 2);
+      adr = apu_spcRead(apu, 0);
+      adr = ((adr | (apu_spcRead(apu, 1) << 8)) + spc->y) & 0xffff;
+      apu_skipCycles(apu, 1);
+      apu_spcRead(apu, adr);
+      apu_spcWrite(apu, adr, spc->a);
+      apu_skipCycles(apu, 6);
+      spc->y++;
+      spc->z = false;
+      spc->n = spc->y & 0x80;
+      spc->adr = adr;
+      spc->opcode = 0xd0;
+      spc->dat = 0xf3;
+      return true;
+    }
+  }
+  return false;
+}
+
+int apu_startIplReceive(Apu* apu, uint8_t index) {
+  // start of a bulk upload (see snes_runUpload): the boot rom's receive loop has to have taken the byte
+  // with this index; runs it on to where it waits for the next one, and returns how many bytes it can take
+  // from there with apu_iplReceive: the last byte of a page and stores to the pointer or the io registers
+  // are interpreted. returns 0 if it is not in that loop
+  Spc* spc = apu->spc;
+  if(!apu->fastIpl || !apu->romReadable || spc->p || spc->resetWanted || spc->stopped) return 0;
+  if(apu->inPorts[0] != index || apu->outPorts[0] != index || spc->pc < 0xffda || spc->pc > 0xffea) return 0;
+  for(int i = 0; i < 16 && (spc->pc != 0xffda || spc->step != 0); i++) {
+    spc_runOpcode(spc);
+  }
+  if(spc->pc != 0xffda || spc->step != 0 || spc->y != ((index + 1) & 0xff) || apu->outPorts[0] != index) return 0;
+  uint16_t pointer = apu->ram[0] | (apu->ram[1] << 8);
+  int count = 0;
+  while(spc->y + count < 0xff) {
+    uint16_t adr = pointer + spc->y + count;
+    if(adr < 2 || (adr & 0xfff0) == 0xf0) break;
+    count++;
+  }
+  return count;
+}
+
+bool apu_iplReceive(Apu* apu, uint8_t index, uint8_t val) {
+  // the cpu writes the next byte and its index to ports 1 and 0, and the receive loop takes it in its
+  // nominal 25 cycles (after apu_startIplReceive); returns false, leaving everything as is, if the loop
+  // is not waiting for that index
+  Spc* spc = apu->spc;
+  if(spc->pc != 0xffda || spc->step != 0 || spc->y != index || !apu->romReadable) return false;
+  apu->inPorts[0] = index;
+  apu->inPorts[1] = val;
+  uint16_t adr = ((apu->ram[0] | (apu->ram[1] << 8)) + spc->y) & 0xffff;
+  apu_write(apu, 0xf4, index);
+  apu_write(apu, adr, val);
+  apu_skipCycles(apu, 25);
+  spc->a = val;
+  spc->y++;
+  spc->c = true;
+  spc->z = false;
+  spc->n = spc->y & 0x80;
+  spc->adr = adr;
+  spc->opcode = 0xd0;
+  spc->dat = 0xf3;
+  return true;
+}
+
+int apu_getIplByteCycles(Apu* apu) {
+  // master cycles for one byte of the receive loop, rounded up to the snes' 2 cycle steps
+  uint32_t num = apu->snes->palTiming ? apuClockNumPal : apuClockNum;
+  uint32_t den = apu->snes->palTiming ? apuClockDenPal : apuClockDen;
+  return ((25 * den + num - 1) / num + 1) & ~1;
+}
+
+void apu_catchupDsp(Apu* apu) {
+  // run the dsp for every 32nd cycle since the last catchup
+  uint64_t next = (apu->dspCycles + 0x1f) & ~0x1full;
+  while(next < apu->cycles) {
     dsp_cycle(apu->dsp);
+    next += 32;
   }
+  apu->dspCycles = apu->cycles;
+  apu_updateDspPages(apu);
+}
+
+static void apu_updateDspPages(Apu* apu) {
+  memset(apu->dspReadPages, 0, sizeof(apu->dspReadPages));
+  memset(apu->dspWritePages, 0, sizeof(apu->dspWritePages));
+  dsp_getRamPages(apu->dsp, apu->dspReadPages, apu->dspWritePages);
+}
 
-  // handle timers
+static void apu_catchupTimers(Apu* apu) {
+  // the stage 1 dividers tick on every cycle that is a multiple of 128 (16 for timer 2), the stage 2
+  // divider counts those ticks and increments the counter each time it reaches the target
   for(int i = 0; i < 3; i++) {
-    if(apu->timer[i].cycles == 0) {
-      apu->timer[i].cycles = i == 2 ? 16 : 128;
-      if(apu->timer[i].enabled) {
-        apu->timer[i].divider++;
-        if(apu->timer[i].divider == apu->timer[i].target) {
-          apu->timer[i].divider = 0;
-          apu->timer[i].counter++;
-          apu->timer[i].counter &= 0xf;
-        }
-      }
+    int shift = i == 2 ? 4 : 7;
+    uint64_t ticks = (apu->cycles >> shift) - (apu->timerCycles >> shift);
+    if((apu->timerCycles & ((1 << shift) - 1)) == 0) ticks++;
+    if((apu->cycles & ((1 << shift) - 1)) == 0) ticks--;
+    if(!apu->timer[i].enabled || ticks == 0) continue;
+    uint32_t first = (uint8_t) (apu->timer[i].target - apu->timer[i].divider); // ticks until the target is reached
+    if(first == 0) first = 256;
+    if(ticks < first) {
+      apu->timer[i].divider += ticks;
+    } else {
+      uint32_t period = apu->timer[i].target == 0 ? 256 : apu->timer[i].target;
+      ticks -= first;
+      apu->timer[i].counter = (apu->timer[i].counter + 1 + ticks / period) & 0xf;
+      apu->timer[i].divider = ticks % period;
     }
-    apu->timer[i].cycles--;
   }
+  apu->timerCycles = apu->cycles;
+}
 
+static void apu_skipCycles(Apu* apu, uint64_t cycles) {
+  // same as calling apu_cycle that many times, for cycles whose accesses have no side effects
+  bool catchup = ((apu->cycles + 0x7ff) >> 11) != ((apu->cycles + cycles + 0x7ff) >> 11);
+  apu->cycles += cycles;
+  if(catchup) apu_catchupDsp(apu);
+}
+
+static void apu_cycle(Apu* apu) {
+  if((apu->cycles & 0x7ff) == 0) {
+    // catch up at least every 64 samples, which bounds the ram the dsp can touch meanwhile
+    apu_catchupDsp(apu);
+  }
   apu->cycles++;
 }
 
 uint8_t apu_read(Apu* apu, uint16_t adr) {
+  if(apu->dspWritePages[adr >> 11] & (1 << ((adr >> 8) & 7))) apu_catchupDsp(apu); // echo buffer
   switch(adr) {
     case 0xf0:
     case 0xf1:
@@ -152,6 +311,7 @@ uint8_t apu_read(Apu* apu, uint16_t adr) {
       return apu->dspAdr;
     }
     case 0xf3: {
+      apu_catchupDsp(apu);
       return dsp_read(apu->dsp, apu->dspAdr & 0x7f);
     }
     case 0xf4:
@@ -165,23 +325,28 @@ uint8_t apu_read(Apu* apu, uint16_t adr) {
     case 0xfd:
     case 0xfe:
     case 0xff: {
+      apu_catchupTimers(apu);
       uint8_t ret = apu->timer[adr - 0xfd].counter;
       apu->timer[adr - 0xfd].counter = 0;
       return ret;
     }
   }
   if(apu->romReadable && adr >= 0xffc0) {
-    return bootRom[adr - 0xffc0];
+    return apu->bootRom[adr - 0xffc0];
   }
   return apu->ram[adr];
 }
 
 void apu_write(Apu* apu, uint16_t adr, uint8_t val) {
+  // brr or echo data, the dsp has to see the old value until now
+  bool dspPage = apu->dspReadPages[adr >> 11] & (1 << ((adr >> 8) & 7));
+  if(dspPage) apu_catchupDsp(apu);
   switch(adr) {
     case 0xf0: {
       break; // test register
     }
     case 0xf1: {
+      apu_catchupTimers(apu);
       for(int i = 0; i < 3; i++) {
         if(!apu->timer[i].enabled && (val & (1 << i))) {
           apu->timer[i].divider = 0;
@@ -205,7 +370,9 @@ void apu_write(Apu* apu, uint16_t adr, uint8_t val) {
       break;
     }
     case 0xf3: {
+      apu_catchupDsp(apu);
       if(apu->dspAdr < 0x80) dsp_write(apu->dsp, apu->dspAdr, val);
+      dspPage = true; // directory, sources and echo region may have moved
       break;
     }
     case 0xf4:
@@ -223,11 +390,15 @@ void apu_write(Apu* apu, uint16_t adr, uint8_t val) {
     case 0xfa:
     case 0xfb:
     case 0xfc: {
+      apu_catchupTimers(apu);
       apu->timer[adr - 0xfa].target = val;
       break;
     }
   }
   apu->ram[adr] = val;
+  apu->pageGenerations[adr >> 8]++;
+  apu->ramPageEpochs[adr >> 8] = apu->snes->dirtyEpoch;
+  if(dspPage) apu_updateDspPages(apu);
 }
 
 uint8_t apu_spcRead(void* mem, uint16_t adr) {
@@ -20,41 +20,38 @@ static uint8_t cart_readExHirom(Cart* cart, uint8_t bank, uint16_t adr);
 static void cart_writeHirom(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val);
 static uint8_t cart_readCX4(Cart* cart, uint8_t bank, uint16_t adr);
 static void cart_writeCX4(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val);
+static void cart_freeRam(Cart* cart);
 
-#ifdef TARGET_GNW
-static Cart g_static_cart;
-#endif
-
-Cart* cart_init(Snes* snes) {
-#ifndef TARGET_GNW
-  Cart* cart = malloc(sizeof(Cart));
-#else
-  Cart* cart = &g_static_cart;
-#endif
+void cart_init(Cart* cart, Snes* snes) {
+  // ramRoom is set up by snes_init
   cart->snes = snes;
   cart->type = 0;
   cart->hasBattery = 0;
   cart->rom = NULL;
   cart->romSize = 0;
+  cart->romShared = false;
   cart->ram = NULL;
   cart->ramSize = 0;
-  return cart;
 }
 
-#ifndef TARGET_GNW
+#if !defined(TARGET_GNW) || defined(LINUX_EMU)
 void cart_free(Cart* cart) {
-  if(cart->rom != NULL) free(cart->rom);
-  if(cart->ram != NULL) free(cart->ram);
-  free(cart);
+  if(cart->rom != NULL && !cart->romShared) free(cart->rom);
+  cart_freeRam(cart);
 }
 #endif
 
+static void cart_freeRam(Cart* cart) {
+  // only frees ram that was allocated for it
+  if(cart->ram != NULL && cart->ram != cart->ramRoom) free(cart->ram);
+}
+
 void cart_reset(Cart* cart) {
   // do not reset ram, assumed to be battery backed
   switch (cart->type) {
     case 0x04:
-      cx4_init(cart->snes);
-      cx4_reset();
+      cx4_init(cart->cx4, cart->snes);
+      cx4_reset(cart->cx4);
       break;
   }
 }
@@ -76,25 +73,43 @@ bool cart_handleTypeState(Cart* cart, StateHandler* sh) {
 }
 
 void cart_handleState(Cart* cart, StateHandler* sh) {
-  if(cart->ram != NULL) sh_handleByteArray(sh, cart->ram, cart->ramSize);
+  if(cart->ram != NULL && !sh->saving && sh->offset + (int) cart->ramSize <= sh->size) {
+    // only pages that change count as written, so that the state loads of run-ahead and rewind do not make
+    // the (mapped) battery ram look dirty each frame
+    const uint8_t* data = sh->data + sh->offset;
+    for(uint32_t i = 0; i < cart->ramSize; i += 0x100) {
+      uint32_t length = cart->ramSize - i < 0x100 ? cart->ramSize - i : 0x100;
+      if(memcmp(cart->ram + i, data + i, length) == 0) continue;
+      memcpy(cart->ram + i, data + i, length);
+      cart->ramPageEpochs[(i >> 8) & 0x1ff] = cart->snes->dirtyEpoch;
+    }
+    sh->offset += cart->ramSize;
+  } else if(cart->ram != NULL) {
+    sh_handleByteArray(sh, cart->ram, cart->ramSize);
+  }
 
   switch(cart->type) {
-    case 4: cx4_handleState(sh); break;
+    case 4: cx4_handleState(cart->cx4, sh); break;
   }
 }
 
 void cart_load(Cart* cart, int type, uint8_t* rom, int romSize, int ramSize, bool hasBattery) {
   cart->type = type;
   cart->hasBattery = hasBattery;
-  if(cart->ram != NULL) free(cart->ram);
+  cart_freeRam(cart);
 #ifndef TARGET_GNW
-  if(cart->rom != NULL) free(cart->rom);
+  if(cart->rom != NULL && !cart->romShared) free(cart->rom);
   cart->rom = malloc(romSize);
+  cart->romShared = false;
 #else
   cart->rom = rom;
+  cart->romShared = true; // the caller's
 #endif
   cart->romSize = romSize;
-  if(ramSize > 0) {
+  if(ramSize > 0 && (uint32_t) ramSize <= cart->ramRoomSize) {
+    cart->ram = cart->ramRoom;
+    memset(cart->ram, 0, ramSize);
+  } else if(ramSize > 0) {
 #if !defined(TARGET_GNW) || defined(LINUX_EMU)
     cart->ram = malloc(ramSize);
     memset(cart->ram, 0, ramSize);
@@ -146,6 +161,64 @@ void cart_write(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val) {
   }
 }
 
+uint8_t* cart_getPointer(Cart* cart, uint8_t bank, uint16_t adr, bool write, int* before, int* after) {
+  // returns a pointer if adr maps to plain rom (for reading) or sram, and how many bytes precede and follow it linearly
+  uint8_t* mem = NULL;
+  uint32_t size = 0;
+  uint32_t memAdr = 0;
+  uint32_t low = 0;
+  switch(cart->type) {
+    case 1:
+    case 4: {
+      bool sram = ((bank >= 0x70 && bank < 0x7e) || bank >= 0xf0) && cart->ramSize > 0 && (
+        adr < 0x8000 || (cart->type == 1 && cart->romSize < 0x200000)
+      );
+      if(sram) {
+        if(write && bank == 0xf0) return NULL; // not written, see cart_writeLorom
+        mem = cart->ram;
+        size = cart->ramSize;
+        memAdr = ((bank & 0xf) << 15) | adr;
+        low = adr & 0x7fff;
+      } else if(!write && (adr >= 0x8000 || (bank & 0x7f) >= 0x40)) {
+        mem = cart->rom;
+        size = cart->romSize;
+        memAdr = ((bank & 0x7f) << 15) | (adr & 0x7fff);
+        low = adr & 0x7fff;
+      } else {
+        return NULL;
+      }
+      *after = 0x8000 - low;
+      break;
+    }
+    case 2:
+    case 3: {
+      if((bank & 0x7f) < 0x40 && adr >= 0x6000 && adr < 0x8000 && cart->ramSize > 0) {
+        mem = cart->ram;
+        size = cart->ramSize;
+        memAdr = ((bank & 0x3f) << 13) | (adr & 0x1fff);
+        low = adr & 0x1fff;
+        *after = 0x2000 - low;
+      } else if(!write && (adr >= 0x8000 || (bank & 0x7f) >= 0x40)) {
+        bool secondHalf = cart->type == 3 && bank < 0x80;
+        mem = cart->rom;
+        size = cart->romSize;
+        memAdr = ((bank & 0x3f) << 16) | (secondHalf ? 0x400000 : 0) | adr;
+        low = (bank & 0x7f) < 0x40 ? adr & 0x7fff : adr;
+        *after = 0x10000 - adr;
+      } else {
+        return NULL;
+      }
+      break;
+    }
+    default: return NULL;
+  }
+  if(size == 0 || (size & (size - 1)) != 0) return NULL;
+  memAdr &= size - 1;
+  if(memAdr + *after > size) *after = size - memAdr;
+  if(before != NULL) *before = low < memAdr ? low : memAdr;
+  return &mem[memAdr];
+}
+
 static uint8_t cart_readLorom(Cart* cart, uint8_t bank, uint16_t adr) {
   if(((bank >= 0x70 && bank < 0x7e) || bank >= 0xf0) && ((cart->romSize >= 0x200000 && adr < 0x8000) || (cart->romSize < 0x200000)) && cart->ramSize > 0) {
     // banks 70-7d and f0-ff, adr 0000-7fff & rom >= 2MB || adr 0000-ffff & rom < 2MB
@@ -162,7 +235,9 @@ static uint8_t cart_readLorom(Cart* cart, uint8_t bank, uint16_t adr) {
 static void cart_writeLorom(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val) {
   if(((bank >= 0x70 && bank < 0x7e) || bank > 0xf0) && ((cart->romSize >= 0x200000 && adr < 0x8000) || (cart->romSize < 0x200000)) && cart->ramSize > 0) {
     // banks 70-7d and f0-ff, adr 0000-7fff & rom >= 2MB || adr 0000-ffff & rom < 2MB
-    cart->ram[(((bank & 0xf) << 15) | adr) & (cart->ramSize - 1)] = val;
+    uint32_t ramAdr = (((bank & 0xf) << 15) | adr) & (cart->ramSize - 1);
+    cart->ram[ramAdr] = val;
+    cart->ramPageEpochs[(ramAdr >> 8) & 0x1ff] = cart->snes->dirtyEpoch;
   }
 }
 
@@ -170,7 +245,7 @@ static uint8_t cart_readCX4(Cart* cart, uint8_t bank, uint16_t adr) {
   // cx4 mapper
   if((bank & 0x7f) < 0x40 && adr >= 0x6000 && adr < 0x8000) {
     // banks 00-3f and 80-bf, adr 6000-7fff
-	return cx4_read(adr);
+	return cx4_read(cart->cx4, adr);
   }
   // save ram
   if(((bank >= 0x70 && bank < 0x7e) || bank >= 0xf0) && adr < 0x8000 && cart->ramSize > 0) {
@@ -189,12 +264,14 @@ static void cart_writeCX4(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val) {
   // cx4 mapper
   if((bank & 0x7f) < 0x40 && adr >= 0x6000 && adr < 0x8000) {
     // banks 00-3f and 80-bf, adr 6000-7fff
-	cx4_write(adr, val);
+	cx4_write(cart->cx4, adr, val);
   }
   // save ram
   if(((bank >= 0x70 && bank < 0x7e) || bank > 0xf0) && adr < 0x8000 && cart->ramSize > 0) {
     // banks 70-7d and f0-ff, adr 0000-7fff
-    cart->ram[(((bank & 0xf) << 15) | adr) & (cart->ramSize - 1)] = val;
+    uint32_t ramAdr = (((bank & 0xf) << 15) | adr) & (cart->ramSize - 1);
+    cart->ram[ramAdr] = val;
+    cart->ramPageEpochs[(ramAdr >> 8) & 0x1ff] = cart->snes->dirtyEpoch;
   }
 }
 
@@ -229,6 +306,8 @@ static void cart_writeHirom(Cart* cart, uint8_t bank, uint16_t adr, uint8_t val)
   bank &= 0x7f;
   if(bank < 0x40 && adr >= 0x6000 && adr < 0x8000 && cart->ramSize > 0) {
     // banks 00-3f and 80-bf, adr 6000-7fff
-    cart->ram[(((bank & 0x3f) << 13) | (adr & 0x1fff)) & (cart->ramSize - 1)] = val;
+    uint32_t ramAdr = (((bank & 0x3f) << 13) | (adr & 0x1fff)) & (cart->ramSize - 1);
+    cart->ram[ramAdr] = val;
+    cart->ramPageEpochs[(ramAdr >> 8) & 0x1ff] = cart->snes->dirtyEpoch;
   }
 }
@@ -15,6 +15,7 @@ static void cpu_idleWait(Cpu* cpu);
 static void cpu_checkInt(Cpu* cpu);
 static uint8_t cpu_readOpcode(Cpu* cpu);
 static uint16_t cpu_readOpcodeWord(Cpu* cpu, bool intCheck);
+static void cpu_doBlockMove(Cpu* cpu, uint8_t dest, uint8_t src, int step);
 static uint8_t cpu_getFlags(Cpu* cpu);
 static void cpu_setFlags(Cpu* cpu, uint8_t value);
 static void cpu_setZN(Cpu* cpu, uint16_t value, bool byte);
@@ -28,30 +29,15 @@ static void cpu_writeWord(Cpu* cpu, uint32_t adrl, uint32_t adrh, uint16_t value
 static void cpu_doInterrupt(Cpu* cpu);
 static void cpu_doOpcode(Cpu* cpu, uint8_t opcode);
 
-#ifdef TARGET_GNW
-static Cpu g_static_cpu;
-#endif
-
 // addressing modes and opcode functions not declared, only used after defintions
 
-Cpu* cpu_init(void* mem, CpuReadHandler read, CpuWriteHandler write, CpuIdleHandler idle) {
-#ifndef TARGET_GNW
-  Cpu* cpu = malloc(sizeof(Cpu));
-#else
-  Cpu* cpu = &g_static_cpu;
-#endif
+void cpu_init(Cpu* cpu, void* mem, CpuReadHandler read, CpuWriteHandler write, CpuIdleHandler idle, CpuBlockMoveHandler blockMove) {
   cpu->mem = mem;
   cpu->read = read;
   cpu->write = write;
   cpu->idle = idle;
-  return cpu;
-}
-
-#ifndef TARGET_GNW
-void cpu_free(Cpu* cpu) {
-  free(cpu);
+  cpu->blockMove = blockMove;
 }
-#endif
 
 void cpu_reset(Cpu* cpu, bool hard) {
   if(hard) {
@@ -178,6 +164,27 @@ static uint16_t cpu_readOpcodeWord(Cpu* cpu, bool intCheck) {
   return low | (cpu_readOpcode(cpu) << 8);
 }
 
+static void cpu_doBlockMove(Cpu* cpu, uint8_t dest, uint8_t src, int step) {
+  // let the memory handler do the remaining mvn/mvp iterations at once where it can (pc is at the opcode again)
+  if(cpu->blockMove == NULL || cpu->intWanted || cpu->nmiWanted || (cpu->irqWanted && !cpu->i)) return;
+  int size = cpu->xf ? 0x100 : 0x10000;
+  int count = cpu->a + 1;
+  // x and y can not wrap around within the move
+  int room = step > 0 ? size - cpu->x : cpu->x + 1;
+  if(room < count) count = room;
+  room = step > 0 ? size - cpu->y : cpu->y + 1;
+  if(room < count) count = room;
+  int done = cpu->blockMove(cpu->mem, (cpu->k << 16) | cpu->pc, (src << 16) | cpu->x, (dest << 16) | cpu->y, step, count);
+  cpu->a -= done;
+  cpu->x += step * done;
+  cpu->y += step * done;
+  if(cpu->xf) {
+    cpu->x &= 0xff;
+    cpu->y &= 0xff;
+  }
+  if(cpu->a == 0xffff) cpu->pc += 3;
+}
+
 static uint8_t cpu_getFlags(Cpu* cpu) {
   uint8_t val = cpu->n << 7;
   val |= cpu->v << 6;
@@ -1271,6 +1278,7 @@ static void cpu_doOpcode(Cpu* cpu, uint8_t opcode) {
       cpu_idle(cpu);
       cpu_checkInt(cpu);
       cpu_idle(cpu);
+      if(cpu->a != 0xffff) cpu_doBlockMove(cpu, dest, src, -1);
       break;
     }
     case 0x45: { // eor dp
@@ -1386,6 +1394,7 @@ static void cpu_doOpcode(Cpu* cpu, uint8_t opcode) {
       cpu_idle(cpu);
       cpu_checkInt(cpu);
       cpu_idle(cpu);
+      if(cpu->a != 0xffff) cpu_doBlockMove(cpu, dest, src, 1);
       break;
     }
     case 0x55: { // eor dpx
@@ -25,30 +25,20 @@ static const int transferLength[8] = {
 };
 
 static void dma_transferByte(Dma* dma, uint16_t aAdr, uint8_t aBank, uint8_t bAdr, bool fromB);
+static int dma_bulkTransfer(Dma* dma, DmaChannel* channel, int offIndex);
+static int dma_getHdmaCycles(Dma* dma, int lastActive);
+static void dma_resetHdmaLines(Dma* dma);
+static const uint8_t* dma_getHdmaSource(Dma* dma, uint8_t bank, uint16_t adr, int length);
+static int dma_compileHdma(Dma* dma);
+static bool dma_runHdmaLine(Dma* dma);
 static void dma_waitCycle(Dma* dma);
 static void dma_doDma(Dma* dma, int cpuCycles);
 static void dma_initHdma(Dma* dma, bool doSync, int cpuCycles);
 static void dma_doHdma(Dma* dma, bool doSync, int cpuCycles);
 
-#ifdef TARGET_GNW
-static Dma g_static_dma;
-#endif
-
-Dma* dma_init(Snes* snes) {
-#ifndef TARGET_GNW
-  Dma* dma = malloc(sizeof(Dma));
-#else
-  Dma* dma = &g_static_dma;
-#endif
+void dma_init(Dma* dma, Snes* snes) {
   dma->snes = snes;
-  return dma;
-}
-
-#ifndef TARGET_GNW
-void dma_free(Dma* dma) {
-  free(dma);
 }
-#endif
 
 void dma_reset(Dma* dma) {
   for(int i = 0; i < 8; i++) {
@@ -74,6 +64,7 @@ void dma_reset(Dma* dma) {
   dma->dmaState = 0;
   dma->hdmaInitRequested = false;
   dma->hdmaRunRequested = false;
+  dma_resetHdmaLines(dma);
 }
 
 void dma_handleState(Dma* dma, StateHandler* sh) {
@@ -91,6 +82,7 @@ void dma_handleState(Dma* dma, StateHandler* sh) {
     );
     sh_handleWords(sh, &dma->channel[i].aAdr, &dma->channel[i].size, &dma->channel[i].tableAdr, NULL);
   }
+  if(!sh->saving) dma_resetHdmaLines(dma);
 }
 
 uint8_t dma_read(Dma* dma, uint16_t adr) {
@@ -147,6 +139,7 @@ uint8_t dma_read(Dma* dma, uint16_t adr) {
 
 void dma_write(Dma* dma, uint16_t adr, uint8_t val) {
   uint8_t c = (adr & 0x70) >> 4;
+  dma_resetHdmaLines(dma);
   switch(adr & 0xf) {
     case 0x0: {
       dma->channel[c].mode = val & 0x7;
@@ -228,6 +221,11 @@ static void dma_doDma(Dma* dma, int cpuCycles) {
     dma_waitCycle(dma); // overhead per channel
     int offIndex = 0;
     while(dma->channel[i].dmaActive) {
+      int count = dma_bulkTransfer(dma, &dma->channel[i], offIndex);
+      if(count > 0) {
+        offIndex = (offIndex + count) & 3;
+        continue;
+      }
       dma_waitCycle(dma);
       dma_transferByte(
         dma, dma->channel[i].aAdr, dma->channel[i].aBank,
@@ -249,6 +247,7 @@ static void dma_doDma(Dma* dma, int cpuCycles) {
 
 static void dma_initHdma(Dma* dma, bool doSync, int cpuCycles) {
   dma->hdmaInitRequested = false;
+  dma_resetHdmaLines(dma);
   bool hdmaEnabled = false;
   // check if a channel is enabled, and do reset
   for(int i = 0; i < 8; i++) {
@@ -297,8 +296,18 @@ static void dma_doHdma(Dma* dma, bool doSync, int cpuCycles) {
   // nmi/irq is delayed by 1 opcode if requested during dma/hdma
   dma->snes->cpu->intDelay = true;
   if(doSync) snes_syncCycles(dma->snes, true, 8);
+  if(dma_runHdmaLine(dma)) {
+    if(doSync) snes_syncCycles(dma->snes, false, cpuCycles);
+    return;
+  }
+  // this line still matches the compiled one, if any
+  if(dma->hdmaLinePos < dma->hdmaLineCount) dma->hdmaLinePos++;
+  // if nothing can notice the time passing during the transfers, account for it at once
+  int cycles = dma_getHdmaCycles(dma, lastActive);
+  bool timed = cycles == 0 || cycles > snes_getIdleCycles(dma->snes);
+  if(!timed) snes_skipCycles(dma->snes, cycles);
   // full transfer overhead
-  snes_runCycles(dma->snes, 8);
+  if(timed) snes_runCycles(dma->snes, 8);
   // do all copies
   for(int i = 0; i < 8; i++) {
     // terminate any dma
@@ -307,7 +316,7 @@ static void dma_doHdma(Dma* dma, bool doSync, int cpuCycles) {
       // do the hdma
       if(dma->channel[i].doTransfer) {
         for(int j = 0; j < transferLength[dma->channel[i].mode]; j++) {
-          snes_runCycles(dma->snes, 8);
+          if(timed) snes_runCycles(dma->snes, 8);
           if(dma->channel[i].indirect) {
             dma_transferByte(
               dma, dma->channel[i].size++, dma->channel[i].indBank,
@@ -328,7 +337,7 @@ static void dma_doHdma(Dma* dma, bool doSync, int cpuCycles) {
     if(dma->channel[i].hdmaActive && !dma->channel[i].terminated) {
       dma->channel[i].repCount--;
       dma->channel[i].doTransfer = dma->channel[i].repCount & 0x80;
-      snes_runCycles(dma->snes, 8);
+      if(timed) snes_runCycles(dma->snes, 8);
       uint8_t newRepCount = snes_read(dma->snes, (dma->channel[i].aBank << 16) | dma->channel[i].tableAdr);
       if((dma->channel[i].repCount & 0x7f) == 0) {
         dma->channel[i].repCount = newRepCount;
@@ -338,10 +347,10 @@ static void dma_doHdma(Dma* dma, bool doSync, int cpuCycles) {
             // if this is the last active channel, only fetch high, and use 0 for low
             dma->channel[i].size = 0;
           } else {
-            snes_runCycles(dma->snes, 8);
+            if(timed) snes_runCycles(dma->snes, 8);
             dma->channel[i].size = snes_read(dma->snes, (dma->channel[i].aBank << 16) | dma->channel[i].tableAdr++);
           }
-          snes_runCycles(dma->snes, 8);
+          if(timed) snes_runCycles(dma->snes, 8);
           dma->channel[i].size |= snes_read(dma->snes, (dma->channel[i].aBank << 16) | dma->channel[i].tableAdr++) << 8;
         }
         if(dma->channel[i].repCount == 0) dma->channel[i].terminated = true;
@@ -370,6 +379,234 @@ static void dma_transferByte(Dma* dma, uint16_t aAdr, uint8_t aBank, uint8_t bAd
   }
 }
 
+static int dma_getHdmaCycles(Dma* dma, int lastActive) {
+  // returns the time the hdma transfers take if they only read plain memory and write ppu registers, 0 otherwise
+  int length = 0;
+  int units = 1;
+  for(int i = 0; i < 8; i++) {
+    DmaChannel* channel = &dma->channel[i];
+    if(!channel->hdmaActive || channel->terminated) continue;
+    uint16_t tableAdr = channel->tableAdr;
+    if(channel->doTransfer) {
+      int count = transferLength[channel->mode];
+      if(channel->fromB || channel->bAdr + 3 >= 0x40) return 0;
+      if(channel->indirect) {
+        if(snes_getPointer(dma->snes, (channel->indBank << 16) | channel->size, false, NULL, &length) == NULL || length < count) return 0;
+      } else {
+        if(snes_getPointer(dma->snes, (channel->aBank << 16) | tableAdr, false, NULL, &length) == NULL || length < count) return 0;
+        tableAdr += count;
+      }
+      units += count;
+    }
+    const uint8_t* table = snes_getPointer(dma->snes, (channel->aBank << 16) | tableAdr, false, NULL, &length);
+    if(table == NULL || length < 3) return 0;
+    units++;
+    if(((channel->repCount - 1) & 0x7f) == 0 && channel->indirect) {
+      units += (table[0] == 0 && i == lastActive) ? 1 : 2;
+    }
+  }
+  return units * 8;
+}
+
+static void dma_resetHdmaLines(Dma* dma) {
+  // drops the compiled lines, after the channels changed other than by running them
+  dma->hdmaLineCount = 0;
+  dma->hdmaLinePos = 0;
+  dma->hdmaNoCompile = false;
+}
+
+static const uint8_t* dma_getHdmaSource(Dma* dma, uint8_t bank, uint16_t adr, int length) {
+  // returns a pointer to length bytes of plain memory for dma_compileHdma, and notes the pages if it is
+  // writable (NULL if it is not plain memory, or there are too many pages)
+  Snes* snes = dma->snes;
+  int after = 0;
+  const uint8_t* ptr = snes_getPointer(snes, (bank << 16) | adr, false, NULL, &after);
+  if(ptr == NULL || after < length) return NULL;
+  int start = 0;
+  uint16_t area = 0;
+  if(ptr >= snes->ram && ptr < snes->ram + sizeof(snes->ram)) {
+    start = ptr - snes->ram;
+  } else if(snes->cart->ram != NULL && ptr >= snes->cart->ram && ptr < snes->cart->ram + snes->cart->ramSize) {
+    start = ptr - snes->cart->ram;
+    area = 0x8000;
+  } else {
+    return ptr; // rom
+  }
+  for(int page = start >> 8; page <= (start + length - 1) >> 8; page++) {
+    if(page >= 0x200) return NULL; // beyond the tracked cart ram pages
+    int i = 0;
+    while(i < dma->hdmaPageCount && dma->hdmaPages[i] != (area | page)) i++;
+    if(i == dma->hdmaPageCount) {
+      if(i == DMA_HDMA_PAGES) return NULL;
+      dma->hdmaPages[dma->hdmaPageCount++] = area | page;
+    }
+  }
+  return ptr;
+}
+
+static int dma_compileHdma(Dma* dma) {
+  // runs the active channels ahead for up to DMA_HDMA_LINES lines, into per-line lists of the values they
+  // write and their state after each line, as long as they read plain memory and write ppu registers; a
+  // write to a page of wram or cart ram they read ends the lines (see dma_runHdmaLine). returns the amount
+  int lines = DMA_HDMA_LINES;
+  dma->hdmaPageCount = 0;
+  memset(dma->hdmaLineUnits, 1, sizeof(dma->hdmaLineUnits)); // transfer overhead
+  for(int i = 0; i < 8; i++) {
+    DmaChannel c = dma->channel[i];
+    if(!c.hdmaActive || c.terminated) continue;
+    if(c.fromB || c.bAdr + 3 >= 0x40) return 0;
+    for(int k = 0; k < lines && !c.terminated; k++) {
+      HdmaLine* line = &dma->hdmaLines[i][k];
+      int units = 0;
+      line->writes = 0;
+      if(c.doTransfer) {
+        int count = transferLength[c.mode];
+        const uint8_t* src = c.indirect ?
+          dma_getHdmaSource(dma, c.indBank, c.size, count) : dma_getHdmaSource(dma, c.aBank, c.tableAdr, count);
+        if(src == NULL) {
+          lines = k;
+          break;
+        }
+        memcpy(line->values, src, count);
+        line->writes = count;
+        if(c.indirect) {
+          c.size += count;
+        } else {
+          c.tableAdr += count;
+        }
+        units += count;
+      }
+      c.repCount--;
+      c.doTransfer = c.repCount & 0x80;
+      bool reload = (c.repCount & 0x7f) == 0;
+      const uint8_t* table = dma_getHdmaSource(dma, c.aBank, c.tableAdr, reload && c.indirect ? 3 : 1);
+      // a terminating indirect channel depends on the others (dma_doHdma's last active channel)
+      if(table == NULL || (reload && c.indirect && table[0] == 0)) {
+        lines = k;
+        break;
+      }
+      line->lastRead = table[0];
+      units++;
+      if(reload) {
+        c.repCount = table[0];
+        c.tableAdr++;
+        if(c.indirect) {
+          c.size = table[1] | (table[2] << 8);
+          c.tableAdr += 2;
+          line->lastRead = table[2];
+          units += 2;
+        }
+        if(c.repCount == 0) c.terminated = true;
+        c.doTransfer = true;
+      }
+      line->repCount = c.repCount;
+      line->tableAdr = c.tableAdr;
+      line->size = c.size;
+      line->doTransfer = c.doTransfer;
+      line->terminated = c.terminated;
+      dma->hdmaLineUnits[k] += units;
+    }
+  }
+  dma->hdmaEpoch = (lines > 0 && dma->hdmaPageCount > 0) ? snes_newEpoch(dma->snes) : 0;
+  return lines;
+}
+
+static bool dma_runHdmaLine(Dma* dma) {
+  // runs the next line from the compiled ones (compiling more as needed), when nothing can notice the time it
+  // takes passing at once; returns false to run it normally
+  Snes* snes = dma->snes;
+  if(dma->hdmaLinePos < dma->hdmaLineCount && dma->hdmaEpoch != 0) {
+    // a wram or cart ram page they read was written since
+    bool written = snes->allDirtyEpoch >= dma->hdmaEpoch || snes->stateEpoch >= dma->hdmaEpoch;
+    for(int i = 0; i < dma->hdmaPageCount && !written; i++) {
+      uint16_t page = dma->hdmaPages[i];
+      const uint32_t* epochs = (page & 0x8000) ? snes->cart->ramPageEpochs : snes->ramPageEpochs;
+      written = epochs[page & 0x1ff] >= dma->hdmaEpoch;
+    }
+    if(written) {
+      dma->hdmaLineCount = 0;
+      dma->hdmaLinePos = 0;
+      dma->hdmaNoCompile = true;
+    }
+  }
+  if(dma->hdmaLinePos >= dma->hdmaLineCount) {
+    if(dma->hdmaNoCompile) return false;
+    dma->hdmaLinePos = 0;
+    dma->hdmaLineCount = dma_compileHdma(dma);
+    if(dma->hdmaLineCount == 0) {
+      dma->hdmaNoCompile = true;
+      return false;
+    }
+  }
+  int pos = dma->hdmaLinePos;
+  int cycles = dma->hdmaLineUnits[pos] * 8;
+  if(cycles > snes_getIdleCycles(snes)) return false;
+  dma->hdmaLinePos++;
+  snes_skipCycles(snes, cycles);
+  for(int i = 0; i < 8; i++) {
+    DmaChannel* channel = &dma->channel[i];
+    if(!channel->hdmaActive) continue;
+    channel->dmaActive = false;
+    if(channel->terminated) continue;
+    const HdmaLine* line = &dma->hdmaLines[i][pos];
+    for(int j = 0; j < line->writes; j++) {
+      snes_writeBBus(snes, channel->bAdr + bAdrOffsets[channel->mode][j], line->values[j]);
+    }
+  }
+  for(int i = 0; i < 8; i++) {
+    DmaChannel* channel = &dma->channel[i];
+    if(!channel->hdmaActive || channel->terminated) continue;
+    const HdmaLine* line = &dma->hdmaLines[i][pos];
+    channel->repCount = line->repCount;
+    channel->tableAdr = line->tableAdr;
+    channel->size = line->size;
+    channel->doTransfer = line->doTransfer;
+    channel->terminated = line->terminated;
+    snes->openBus = line->lastRead;
+  }
+  return true;
+}
+
+static int dma_bulkTransfer(Dma* dma, DmaChannel* channel, int offIndex) {
+  // transfers from plain memory to vram, cgram, oam or $2180 in one go, for as many bytes as fit
+  // before the next event; gives the same result as doing it byte per byte. returns amount done
+  Snes* snes = dma->snes;
+  if(dma->hdmaInitRequested || dma->hdmaRunRequested) return 0;
+  if(channel->fromB || (channel->decrement && !channel->fixed)) return 0;
+  bool alternate = channel->mode == 1 || channel->mode == 5;
+  if(!alternate && channel->mode != 0 && channel->mode != 2 && channel->mode != 6) return 0;
+  uint8_t bAdr = channel->bAdr + bAdrOffsets[channel->mode][offIndex];
+  if(alternate ? channel->bAdr != 0x18 : (
+    bAdr != 0x04 && bAdr != 0x18 && bAdr != 0x19 && bAdr != 0x22 && bAdr != 0x80
+  )) return 0;
+  int length = 0;
+  const uint8_t* src = snes_getPointer(snes, (channel->aBank << 16) | channel->aAdr, false, NULL, &length);
+  if(src == NULL) return 0;
+  // wram to $2180 gives open bus, left to the normal path
+  if(bAdr == 0x80 && src >= snes->ram && src < snes->ram + 0x20000) return 0;
+  int count = channel->size == 0 ? 0x10000 : channel->size;
+  if(!channel->fixed && length < count) count = length;
+  int idle = snes_getIdleCycles(snes) / 8;
+  if(idle < count) count = idle;
+  if(count == 0) return 0;
+  snes_skipCycles(snes, count * 8);
+  int step = channel->fixed ? 0 : 1;
+  if(bAdr == 0x80) {
+    for(int i = 0; i < count; i++) {
+      snes->ramPageEpochs[snes->ramAdr >> 8] = snes->dirtyEpoch;
+      snes->ram[snes->ramAdr++] = src[i * step];
+      snes->ramAdr &= 0x1ffff;
+    }
+  } else {
+    ppu_writeBulk(snes->ppu, bAdr, alternate, src, step, count);
+  }
+  snes->openBus = src[(count - 1) * step];
+  if(!channel->fixed) channel->aAdr += count;
+  channel->size -= count;
+  if(channel->size == 0) channel->dmaActive = false;
+  return count;
+}
+
 void dma_handleDma(Dma* dma, int cpuCycles) {
   // if hdma triggered, do it, except if dmastate indicates dma will be done now
   // (it will be done as part of the dma in that case)
@@ -387,6 +624,7 @@ void dma_handleDma(Dma* dma, int cpuCycles) {
 }
 
 void dma_startDma(Dma* dma, uint8_t val, bool hdma) {
+  dma_resetHdmaLines(dma);
   for(int i = 0; i < 8; i++) {
     if(hdma) {
       dma->channel[i].hdmaActive = val & (1 << i);
@@ -9,6 +9,17 @@
 #include "apu.h"
 #include "statehandler.h"
 
+// interpolation and mixing process all 8 voices at once where available
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SIMD
+#define DSP_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_SIMD
+#define DSP_SIMD_NEON
+#endif
+
 static const int rateValues[32] = {
   0, 2048, 1536, 1280, 1024, 768, 640, 512,
   384, 320, 256, 192, 160, 128, 96, 80,
@@ -56,45 +67,169 @@ static const int gaussValues[512] = {
   0x513, 0x514, 0x514, 0x515, 0x516, 0x516, 0x517, 0x517, 0x517, 0x518, 0x518, 0x518, 0x518, 0x518, 0x519, 0x519
 };
 
+// kaiser-windowed sinc used by dsp_getSamples: 32 taps for 64 (+1) phases between two samples, cut
+// off a bit below the source nyquist frequency, every phase sums to 0x4000
+static const int16_t sincValues[65][32] = {
+  {-7, 21, -43, 70, -92, 94, -56, -39, 207, -450, 755, -1094, 1428, -1710, 1900, 14415,
+   1900, -1710, 1428, -1094, 755, -450, 207, -39, -56, 94, -92, 70, -43, 21, -7, 1},
+  {-8, 21, -43, 69, -89, 88, -47, -53, 222, -463, 761, -1084, 1389, -1616, 1664, 14415,
+   2139, -1803, 1464, -1102, 747, -435, 192, -26, -66, 100, -95, 71, -43, 21, -7, 1},
+  {-8, 22, -43, 67, -85, 81, -37, -66, 237, -476, 766, -1073, 1348, -1521, 1433, 14402,
+   2382, -1893, 1499, -1108, 738, -420, 176, -12, -76, 106, -98, 72, -43, 20, -7, 1},
+  {-8, 22, -43, 66, -82, 75, -27, -78, 251, -487, 769, -1059, 1304, -1424, 1206, 14379,
+   2629, -1982, 1531, -1111, 727, -404, 159, 1, -86, 112, -100, 72, -43, 20, -6, 1},
+  {-9, 22, -43, 65, -78, 69, -17, -91, 264, -498, 771, -1044, 1259, -1326, 984, 14348,
+   2880, -2068, 1561, -1113, 715, -387, 142, 15, -95, 117, -103, 73, -42, 19, -6, 0},
+  {-9, 22, -42, 63, -75, 62, -8, -103, 277, -507, 771, -1027, 1213, -1228, 766, 14306,
+   3133, -2152, 1588, -1113, 702, -368, 125, 29, -105, 123, -105, 74, -42, 19, -5, 0},
+  {-9, 23, -42, 61, -71, 56, 2, -115, 289, -515, 770, -1008, 1164, -1129, 553, 14257,
+   3390, -2233, 1612, -1110, 687, -349, 107, 43, -114, 128, -108, 74, -42, 18, -5, 0},
+  {-9, 23, -41, 60, -67, 49, 11, -126, 300, -523, 767, -987, 1114, -1029, 346, 14197,
+   3649, -2311, 1634, -1105, 670, -329, 89, 57, -124, 133, -110, 74, -41, 17, -4, 0},
+  {-9, 23, -41, 58, -63, 43, 20, -137, 311, -529, 763, -965, 1062, -929, 144, 14134,
+   3910, -2387, 1652, -1099, 652, -309, 70, 71, -133, 138, -112, 74, -40, 17, -4, -1},
+  {-10, 23, -40, 56, -59, 36, 30, -148, 321, -534, 758, -941, 1009, -828, -53, 14054,
+   4174, -2459, 1668, -1090, 633, -287, 51, 86, -142, 143, -113, 74, -40, 16, -3, -1},
+  {-10, 23, -39, 54, -55, 29, 39, -158, 330, -538, 751, -916, 955, -728, -244, 13971,
+   4439, -2528, 1681, -1078, 612, -265, 32, 100, -151, 147, -115, 74, -39, 15, -3, -1},
+  {-10, 22, -39, 52, -51, 23, 47, -168, 339, -541, 743, -889, 900, -628, -430, 13879,
+   4706, -2594, 1691, -1065, 590, -242, 12, 114, -160, 152, -116, 74, -38, 14, -2, -1},
+  {-10, 22, -38, 50, -47, 16, 56, -178, 346, -543, 733, -861, 843, -529, -610, 13782,
+   4975, -2655, 1698, -1050, 566, -219, -7, 128, -168, 156, -117, 73, -37, 13, -2, -2},
+  {-10, 22, -37, 47, -43, 10, 65, -187, 354, -544, 722, -831, 786, -430, -783, 13668,
+   5245, -2713, 1702, -1032, 542, -194, -27, 142, -176, 159, -118, 72, -36, 12, -1, -2},
+  {-10, 22, -36, 45, -39, 3, 73, -196, 360, -544, 710, -800, 728, -332, -951, 13550,
+   5515, -2767, 1702, -1012, 516, -169, -47, 156, -184, 163, -119, 72, -34, 11, 0, -2},
+  {-10, 22, -35, 43, -35, -3, 81, -204, 366, -543, 697, -768, 669, -234, -1113, 13424,
+   5787, -2817, 1700, -990, 488, -144, -67, 169, -192, 166, -119, 71, -33, 10, 0, -2},
+  {-10, 21, -34, 40, -30, -9, 89, -212, 371, -541, 683, -735, 610, -138, -1268, 13290,
+   6058, -2862, 1694, -966, 460, -118, -87, 183, -200, 169, -119, 70, -32, 9, 1, -3},
+  {-10, 21, -33, 38, -26, -15, 96, -219, 375, -538, 667, -701, 550, -43, -1417, 13149,
+   6330, -2902, 1684, -940, 430, -92, -107, 196, -207, 172, -119, 68, -30, 8, 2, -3},
+  {-10, 20, -32, 36, -22, -21, 103, -226, 378, -534, 651, -666, 490, 51, -1560, 13000,
+   6601, -2938, 1672, -912, 400, -65, -127, 209, -213, 174, -119, 67, -29, 7, 2, -3},
+  {-10, 20, -30, 33, -18, -27, 110, -232, 381, -529, 633, -630, 430, 143, -1696, 12844,
+   6872, -2969, 1656, -882, 368, -38, -147, 222, -220, 176, -118, 65, -27, 5, 3, -4},
+  {-10, 20, -29, 31, -13, -33, 117, -238, 383, -523, 614, -593, 369, 234, -1826, 12678,
+   7142, -2995, 1637, -850, 335, -10, -167, 234, -226, 178, -118, 64, -25, 4, 4, -4},
+  {-10, 19, -28, 28, -9, -39, 124, -243, 384, -516, 595, -556, 309, 322, -1949, 12511,
+   7411, -3016, 1614, -816, 301, 18, -187, 246, -232, 179, -117, 62, -24, 3, 4, -4},
+  {-9, 19, -26, 25, -5, -44, 130, -248, 384, -509, 574, -518, 248, 409, -2065, 12329,
+   7679, -3031, 1588, -779, 267, 46, -207, 258, -237, 181, -115, 60, -22, 2, 5, -5},
+  {-9, 18, -25, 23, -1, -50, 135, -252, 384, -500, 552, -479, 188, 494, -2175, 12148,
+   7945, -3041, 1559, -741, 231, 74, -227, 269, -242, 181, -114, 58, -20, 0, 6, -5},
+  {-9, 18, -24, 20, 3, -55, 141, -256, 383, -490, 530, -440, 129, 577, -2279, 11956,
+   8209, -3045, 1526, -702, 195, 102, -246, 280, -247, 182, -112, 55, -18, -1, 7, -5},
+  {-9, 17, -22, 18, 7, -60, 146, -259, 382, -480, 507, -400, 69, 657, -2375, 11756,
+   8471, -3044, 1490, -660, 158, 131, -265, 291, -251, 182, -110, 53, -16, -2, 7, -5},
+  {-9, 16, -21, 15, 11, -65, 151, -262, 379, -469, 483, -360, 11, 735, -2465, 11555,
+   8731, -3037, 1451, -617, 120, 159, -283, 301, -255, 182, -108, 51, -14, -4, 8, -6},
+  {-9, 16, -20, 13, 15, -70, 155, -264, 376, -457, 459, -320, -47, 810, -2549, 11347,
+   8988, -3024, 1408, -572, 82, 188, -302, 310, -258, 181, -106, 48, -12, -5, 9, -6},
+  {-8, 15, -18, 10, 18, -74, 160, -266, 372, -444, 433, -279, -105, 883, -2625, 11131,
+   9241, -3005, 1362, -525, 43, 216, -320, 320, -261, 180, -103, 45, -9, -7, 10, -6},
+  {-8, 14, -17, 7, 22, -79, 163, -267, 368, -431, 408, -238, -161, 953, -2695, 10912,
+   9492, -2980, 1313, -477, 4, 244, -337, 328, -263, 179, -100, 42, -7, -8, 10, -7},
+  {-8, 14, -15, 5, 26, -83, 167, -268, 363, -417, 382, -198, -217, 1021, -2759, 10685,
+   9739, -2948, 1261, -428, -36, 272, -354, 336, -265, 177, -97, 39, -5, -9, 11, -7},
+  {-8, 13, -14, 2, 29, -87, 170, -268, 357, -402, 355, -157, -271, 1085, -2816, 10456,
+   9982, -2910, 1205, -377, -76, 300, -371, 344, -266, 175, -94, 36, -2, -11, 12, -7},
+  {-7, 12, -12, 0, 33, -91, 173, -267, 351, -387, 328, -117, -325, 1147, -2866, 10221,
+   10219, -2866, 1147, -325, -117, 328, -387, 351, -267, 173, -91, 33, 0, -12, 12, -7},
+  {-7, 12, -11, -2, 36, -94, 175, -266, 344, -371, 300, -76, -377, 1205, -2910, 9982,
+   10456, -2816, 1085, -271, -157, 355, -402, 357, -268, 170, -87, 29, 2, -14, 13, -8},
+  {-7, 11, -9, -5, 39, -97, 177, -265, 336, -354, 272, -36, -428, 1261, -2948, 9739,
+   10685, -2759, 1021, -217, -198, 382, -417, 363, -268, 167, -83, 26, 5, -15, 14, -8},
+  {-7, 10, -8, -7, 42, -100, 179, -263, 328, -337, 244, 4, -477, 1313, -2980, 9492,
+   10912, -2695, 953, -161, -238, 408, -431, 368, -267, 163, -79, 22, 7, -17, 14, -8},
+  {-6, 10, -7, -9, 45, -103, 180, -261, 320, -320, 216, 43, -525, 1362, -3005, 9241,
+   11131, -2625, 883, -105, -279, 433, -444, 372, -266, 160, -74, 18, 10, -18, 15, -8},
+  {-6, 9, -5, -12, 48, -106, 181, -258, 310, -302, 188, 82, -572, 1408, -3024, 8988,
+   11347, -2549, 810, -47, -320, 459, -457, 376, -264, 155, -70, 15, 13, -20, 16, -9},
+  {-6, 8, -4, -14, 51, -108, 182, -255, 301, -283, 159, 120, -617, 1451, -3037, 8731,
+   11555, -2465, 735, 11, -360, 483, -469, 379, -262, 151, -65, 11, 15, -21, 16, -9},
+  {-5, 7, -2, -16, 53, -110, 182, -251, 291, -265, 131, 158, -660, 1490, -3044, 8471,
+   11756, -2375, 657, 69, -400, 507, -480, 382, -259, 146, -60, 7, 18, -22, 17, -9},
+  {-5, 7, -1, -18, 55, -112, 182, -247, 280, -246, 102, 195, -702, 1526, -3045, 8209,
+   11956, -2279, 577, 129, -440, 530, -490, 383, -256, 141, -55, 3, 20, -24, 18, -9},
+  {-5, 6, 0, -20, 58, -114, 181, -242, 269, -227, 74, 231, -741, 1559, -3041, 7945,
+   12148, -2175, 494, 188, -479, 552, -500, 384, -252, 135, -50, -1, 23, -25, 18, -9},
+  {-5, 5, 2, -22, 60, -115, 181, -237, 258, -207, 46, 267, -779, 1588, -3031, 7679,
+   12329, -2065, 409, 248, -518, 574, -509, 384, -248, 130, -44, -5, 25, -26, 19, -9},
+  {-4, 4, 3, -24, 62, -117, 179, -232, 246, -187, 18, 301, -816, 1614, -3016, 7411,
+   12511, -1949, 322, 309, -556, 595, -516, 384, -243, 124, -39, -9, 28, -28, 19, -10},
+  {-4, 4, 4, -25, 64, -118, 178, -226, 234, -167, -10, 335, -850, 1637, -2995, 7142,
+   12678, -1826, 234, 369, -593, 614, -523, 383, -238, 117, -33, -13, 31, -29, 20, -10},
+  {-4, 3, 5, -27, 65, -118, 176, -220, 222, -147, -38, 368, -882, 1656, -2969, 6872,
+   12844, -1696, 143, 430, -630, 633, -529, 381, -232, 110, -27, -18, 33, -30, 20, -10},
+  {-3, 2, 7, -29, 67, -119, 174, -213, 209, -127, -65, 400, -912, 1672, -2938, 6601,
+   13000, -1560, 51, 490, -666, 651, -534, 378, -226, 103, -21, -22, 36, -32, 20, -10},
+  {-3, 2, 8, -30, 68, -119, 172, -207, 196, -107, -92, 430, -940, 1684, -2902, 6330,
+   13149, -1417, -43, 550, -701, 667, -538, 375, -219, 96, -15, -26, 38, -33, 21, -10},
+  {-3, 1, 9, -32, 70, -119, 169, -200, 183, -87, -118, 460, -966, 1694, -2862, 6058,
+   13290, -1268, -138, 610, -735, 683, -541, 371, -212, 89, -9, -30, 40, -34, 21, -10},
+  {-2, 0, 10, -33, 71, -119, 166, -192, 169, -67, -144, 488, -990, 1700, -2817, 5787,
+   13424, -1113, -234, 669, -768, 697, -543, 366, -204, 81, -3, -35, 43, -35, 22, -10},
+  {-2, 0, 11, -34, 72, -119, 163, -184, 156, -47, -169, 516, -1012, 1702, -2767, 5515,
+   13550, -951, -332, 728, -800, 710, -544, 360, -196, 73, 3, -39, 45, -36, 22, -10},
+  {-2, -1, 12, -36, 72, -118, 159, -176, 142, -27, -194, 542, -1032, 1702, -2713, 5245,
+   13668, -783, -430, 786, -831, 722, -544, 354, -187, 65, 10, -43, 47, -37, 22, -10},
+  {-2, -2, 13, -37, 73, -117, 156, -168, 128, -7, -219, 566, -1050, 1698, -2655, 4975,
+   13782, -610, -529, 843, -861, 733, -543, 346, -178, 56, 16, -47, 50, -38, 22, -10},
+  {-1, -2, 14, -38, 74, -116, 152, -160, 114, 12, -242, 590, -1065, 1691, -2594, 4706,
+   13879, -430, -628, 900, -889, 743, -541, 339, -168, 47, 23, -51, 52, -39, 22, -10},
+  {-1, -3, 15, -39, 74, -115, 147, -151, 100, 32, -265, 612, -1078, 1681, -2528, 4439,
+   13971, -244, -728, 955, -916, 751, -538, 330, -158, 39, 29, -55, 54, -39, 23, -10},
+  {-1, -3, 16, -40, 74, -113, 143, -142, 86, 51, -287, 633, -1090, 1668, -2459, 4174,
+   14054, -53, -828, 1009, -941, 758, -534, 321, -148, 30, 36, -59, 56, -40, 23, -10},
+  {-1, -4, 17, -40, 74, -112, 138, -133, 71, 70, -309, 652, -1099, 1652, -2387, 3910,
+   14134, 144, -929, 1062, -965, 763, -529, 311, -137, 20, 43, -63, 58, -41, 23, -9},
+  {0, -4, 17, -41, 74, -110, 133, -124, 57, 89, -329, 670, -1105, 1634, -2311, 3649,
+   14197, 346, -1029, 1114, -987, 767, -523, 300, -126, 11, 49, -67, 60, -41, 23, -9},
+  {0, -5, 18, -42, 74, -108, 128, -114, 43, 107, -349, 687, -1110, 1612, -2233, 3390,
+   14257, 553, -1129, 1164, -1008, 770, -515, 289, -115, 2, 56, -71, 61, -42, 23, -9},
+  {0, -5, 19, -42, 74, -105, 123, -105, 29, 125, -368, 702, -1113, 1588, -2152, 3133,
+   14306, 766, -1228, 1213, -1027, 771, -507, 277, -103, -8, 62, -75, 63, -42, 22, -9},
+  {0, -6, 19, -42, 73, -103, 117, -95, 15, 142, -387, 715, -1113, 1561, -2068, 2880,
+   14348, 984, -1326, 1259, -1044, 771, -498, 264, -91, -17, 69, -78, 65, -43, 22, -9},
+  {1, -6, 20, -43, 72, -100, 112, -86, 1, 159, -404, 727, -1111, 1531, -1982, 2629,
+   14379, 1206, -1424, 1304, -1059, 769, -487, 251, -78, -27, 75, -82, 66, -43, 22, -8},
+  {1, -7, 20, -43, 72, -98, 106, -76, -12, 176, -420, 738, -1108, 1499, -1893, 2382,
+   14402, 1433, -1521, 1348, -1073, 766, -476, 237, -66, -37, 81, -85, 67, -43, 22, -8},
+  {1, -7, 21, -43, 71, -95, 100, -66, -26, 192, -435, 747, -1102, 1464, -1803, 2139,
+   14415, 1664, -1616, 1389, -1084, 761, -463, 222, -53, -47, 88, -89, 69, -43, 21, -8},
+  {1, -7, 21, -43, 70, -92, 94, -56, -39, 207, -450, 755, -1094, 1428, -1710, 1900,
+   14415, 1900, -1710, 1428, -1094, 755, -450, 207, -39, -56, 94, -92, 70, -43, 21, -7}
+};
+
 static int clamp16(int val);
 static int clip16(int val);
 static bool dsp_checkCounter(Dsp* dsp, int rate);
-static void dsp_cycleChannel(Dsp* dsp, int ch);
+static bool dsp_startChannel(Dsp* dsp, int ch, uint16_t* sampleAdr);
+static void dsp_getVoiceSamples(Dsp* dsp, int16_t* samples);
+static void dsp_updateChannel(Dsp* dsp, int ch, int sample, uint16_t sampleAdr, bool delayed);
+static void dsp_mixVoices(Dsp* dsp);
 static void dsp_handleEcho(Dsp* dsp);
+static void dsp_applyFir(const int16_t* left, const int16_t* right, int newL, int newR, const int8_t* firValues, int* sumL, int* sumR);
 static void dsp_handleGain(Dsp* dsp, int ch);
 static void dsp_decodeBrr(Dsp* dsp, int ch);
+static void dsp_clearBrrCache(Dsp* dsp);
+#ifndef DSP_SIMD
 static int16_t dsp_getSample(Dsp* dsp, int ch);
-static void dsp_handleNoise(Dsp* dsp);
-
-#ifdef TARGET_GNW
-static Dsp g_static_dsp;
 #endif
+static void dsp_handleNoise(Dsp* dsp);
 
-Dsp* dsp_init(Apu* apu) {
-#ifndef TARGET_GNW
-  Dsp* dsp = malloc(sizeof(Dsp));
-#else
-  Dsp* dsp = &g_static_dsp;
-#endif
+void dsp_init(Dsp* dsp, Apu* apu) {
   dsp->apu = apu;
-  return dsp;
+  dsp->skipOutput = false;
 }
 
-#ifndef TARGET_GNW
-void dsp_free(Dsp* dsp) {
-  free(dsp);
-}
-#endif
-
 void dsp_reset(Dsp* dsp) {
   memset(dsp->ram, 0, sizeof(dsp->ram));
   dsp->ram[0x7c] = 0xff; // set ENDx
   for(int i = 0; i < 8; i++) {
     dsp->channel[i].pitch = 0;
-    dsp->channel[i].pitchCounter = 0;
     dsp->channel[i].pitchModulation = false;
-    memset(dsp->channel[i].decodeBuffer, 0, sizeof(dsp->channel[i].decodeBuffer));
-    dsp->channel[i].bufferOffset = 0;
     dsp->channel[i].srcn = 0;
     dsp->channel[i].decodeOffset = 0;
     dsp->channel[i].blockOffset = 0;
@@ -110,14 +245,13 @@ void dsp_reset(Dsp* dsp) {
     dsp->channel[i].directGain = false;
     dsp->channel[i].gainValue = 0;
     dsp->channel[i].preclampGain = 0;
-    dsp->channel[i].gain = 0;
     dsp->channel[i].keyOn = false;
     dsp->channel[i].keyOff = false;
-    dsp->channel[i].sampleOut = 0;
-    dsp->channel[i].volumeL = 0;
-    dsp->channel[i].volumeR = 0;
     dsp->channel[i].echoEnable = false;
   }
+  memset(&dsp->voices, 0, sizeof(dsp->voices));
+  dsp->activeVoices = 0xff;
+  dsp_clearBrrCache(dsp);
   dsp->counter = 0;
   dsp->dirPage = 0;
   dsp->evenCycle = true;
@@ -145,6 +279,8 @@ void dsp_reset(Dsp* dsp) {
   memset(dsp->firBufferR, 0, sizeof(dsp->firBufferR));
   memset(dsp->sampleBuffer, 0, sizeof(dsp->sampleBuffer));
   dsp->sampleOffset = 0;
+  atomic_store(&dsp->sampleWritten, 0);
+  atomic_store(&dsp->resamplePos, 0);
   dsp->lastFrameBoundary = 0;
   dsp->sampleCount = 0;
 }
@@ -153,6 +289,33 @@ void dsp_newFrame(Dsp* dsp) {
   dsp->lastFrameBoundary = dsp->sampleOffset;
 }
 
+static void dsp_markPages(uint8_t* pages, uint16_t adr, int length) {
+  // mark all pages touched by [adr, adr + length), wrapping around at 0x10000
+  int first = adr >> 8;
+  int last = (adr + length - 1) >> 8;
+  for(int page = first; page <= last; page++) {
+    pages[(page & 0xff) >> 3] |= 1 << (page & 7);
+  }
+}
+
+void dsp_getRamPages(Dsp* dsp, uint8_t* readPages, uint8_t* writePages) {
+  // conservative set of ram pages the dsp can access within the next 64 samples, as long as no
+  // dsp register gets written: a voice decodes at most 4 brr samples (2.25 bytes) per output sample
+  for(int i = 0; i < 8; i++) {
+    uint16_t samplePointer = dsp->dirPage + 4 * dsp->channel[i].srcn;
+    dsp_markPages(readPages, samplePointer, 4);
+    uint16_t startAdr = dsp->apu->ram[samplePointer] | (dsp->apu->ram[(samplePointer + 1) & 0xffff] << 8);
+    uint16_t loopAdr = dsp->apu->ram[(samplePointer + 2) & 0xffff] | (dsp->apu->ram[(samplePointer + 3) & 0xffff] << 8);
+    dsp_markPages(readPages, dsp->channel[i].decodeOffset, 0x100);
+    dsp_markPages(readPages, startAdr, 0x100);
+    dsp_markPages(readPages, loopAdr, 0x100);
+  }
+  int echoLength = dsp->echoLength > dsp->echoDelay * 4 ? dsp->echoLength : dsp->echoDelay * 4;
+  if(echoLength < 4) echoLength = 4;
+  dsp_markPages(readPages, dsp->echoBufferAdr, echoLength);
+  if(dsp->echoWrites) dsp_markPages(writePages, dsp->echoBufferAdr, echoLength);
+}
+
 void dsp_handleState(Dsp* dsp, StateHandler* sh) {
   sh_handleBools(sh, &dsp->evenCycle, &dsp->mute, &dsp->reset, &dsp->echoWrites, NULL);
   sh_handleBytes(sh, &dsp->noiseRate, &dsp->firBufferIndex, NULL);
@@ -171,31 +334,37 @@ void dsp_handleState(Dsp* dsp, StateHandler* sh) {
     &dsp->firBufferR[2], &dsp->firBufferR[3], &dsp->firBufferR[4], &dsp->firBufferR[5], &dsp->firBufferR[6],
     &dsp->firBufferR[7], NULL
   );
+  memcpy(&dsp->firBufferL[8], dsp->firBufferL, 8 * sizeof(int16_t));
+  memcpy(&dsp->firBufferR[8], dsp->firBufferR, 8 * sizeof(int16_t));
   for(int i = 0; i < 8; i++) {
     sh_handleBools(sh,
       &dsp->channel[i].pitchModulation, &dsp->channel[i].useNoise, &dsp->channel[i].useGain, &dsp->channel[i].directGain,
       &dsp->channel[i].keyOn, &dsp->channel[i].keyOff, &dsp->channel[i].echoEnable, NULL
     );
     sh_handleBytes(sh,
-      &dsp->channel[i].bufferOffset, &dsp->channel[i].srcn, &dsp->channel[i].blockOffset, &dsp->channel[i].brrHeader,
+      &dsp->voices.bufferOffset[i], &dsp->channel[i].srcn, &dsp->channel[i].blockOffset, &dsp->channel[i].brrHeader,
       &dsp->channel[i].startDelay, &dsp->channel[i].adsrRates[0], &dsp->channel[i].adsrRates[1],
       &dsp->channel[i].adsrRates[2], &dsp->channel[i].adsrRates[3], &dsp->channel[i].adsrState,
       &dsp->channel[i].sustainLevel, &dsp->channel[i].gainSustainLevel, &dsp->channel[i].gainMode, NULL
     );
-    sh_handleBytesS(sh, &dsp->channel[i].volumeL, &dsp->channel[i].volumeR, NULL);
+    sh_handleBytesS(sh, &dsp->voices.volumeL[i], &dsp->voices.volumeR[i], NULL);
     sh_handleWords(sh,
-      &dsp->channel[i].pitch, &dsp->channel[i].pitchCounter, &dsp->channel[i].decodeOffset, &dsp->channel[i].gainValue,
-      &dsp->channel[i].preclampGain, &dsp->channel[i].gain, NULL
+      &dsp->channel[i].pitch, &dsp->voices.pitchCounter[i], &dsp->channel[i].decodeOffset, &dsp->channel[i].gainValue,
+      &dsp->channel[i].preclampGain, &dsp->voices.gain[i], NULL
     );
     sh_handleWordsS(sh,
-      &dsp->channel[i].decodeBuffer[0], &dsp->channel[i].decodeBuffer[1], &dsp->channel[i].decodeBuffer[2],
-      &dsp->channel[i].decodeBuffer[3], &dsp->channel[i].decodeBuffer[4], &dsp->channel[i].decodeBuffer[5],
-      &dsp->channel[i].decodeBuffer[6], &dsp->channel[i].decodeBuffer[7], &dsp->channel[i].decodeBuffer[8],
-      &dsp->channel[i].decodeBuffer[9], &dsp->channel[i].decodeBuffer[10], &dsp->channel[i].decodeBuffer[11],
-      &dsp->channel[i].sampleOut, NULL
+      &dsp->voices.decodeBuffer[0][i], &dsp->voices.decodeBuffer[1][i], &dsp->voices.decodeBuffer[2][i],
+      &dsp->voices.decodeBuffer[3][i], &dsp->voices.decodeBuffer[4][i], &dsp->voices.decodeBuffer[5][i],
+      &dsp->voices.decodeBuffer[6][i], &dsp->voices.decodeBuffer[7][i], &dsp->voices.decodeBuffer[8][i],
+      &dsp->voices.decodeBuffer[9][i], &dsp->voices.decodeBuffer[10][i], &dsp->voices.decodeBuffer[11][i],
+      &dsp->voices.sampleOut[i], NULL
     );
   }
   sh_handleByteArray(sh, dsp->ram, 0x80);
+  if(!sh->saving) {
+    dsp->activeVoices = 0xff; // recalculated on the next sample
+    dsp_clearBrrCache(dsp);
+  }
 }
 
 void dsp_cycle(Dsp* dsp) {
@@ -203,9 +372,19 @@ void dsp_cycle(Dsp* dsp) {
   dsp->sampleOutR = 0;
   dsp->echoOutL = 0;
   dsp->echoOutR = 0;
+  // the voices only depend on each other through pitch modulation, which uses the new sample of
+  // the previous voice; so start all, interpolate all, then update them in order and mix
+  uint16_t sampleAdr[8];
+  bool delayed[8];
+  int16_t samples[8];
+  for(int i = 0; i < 8; i++) {
+    delayed[i] = dsp_startChannel(dsp, i, &sampleAdr[i]);
+  }
+  dsp_getVoiceSamples(dsp, samples);
   for(int i = 0; i < 8; i++) {
-    dsp_cycleChannel(dsp, i);
+    dsp_updateChannel(dsp, i, samples[i], sampleAdr[i], delayed[i]);
   }
+  dsp_mixVoices(dsp);
   dsp_handleEcho(dsp); // also applies master volume
   dsp->counter = dsp->counter == 0 ? 30720 - 1 : dsp->counter - 1;
   dsp_handleNoise(dsp);
@@ -215,9 +394,15 @@ void dsp_cycle(Dsp* dsp) {
     dsp->sampleOutL = 0;
     dsp->sampleOutR = 0;
   }
-  // put final sample in the samplebuffer
+  if(dsp->skipOutput) return;
+  // put final sample in the samplebuffer, unless the ring is full: the consumer still reads the 15 samples
+  // before its position for the filter, so the sample is dropped rather than overwriting the oldest of those.
+  // Acquiring the position orders the consumer's reads of the slot before this write
+  uint32_t pos = atomic_load_explicit(&dsp->resamplePos, memory_order_acquire);
+  if((((pos >> 16) - 15 - dsp->sampleOffset) & 0x7ff) == 0) return;
   dsp->sampleBuffer[(dsp->sampleOffset & 0x7ff) * 2] = dsp->sampleOutL;
   dsp->sampleBuffer[(dsp->sampleOffset++ & 0x7ff) * 2 + 1] = dsp->sampleOutR;
+  atomic_store_explicit(&dsp->sampleWritten, dsp->sampleOffset, memory_order_release);
   dsp->sampleCount++;
 }
 
@@ -241,20 +426,15 @@ static void dsp_handleEcho(Dsp* dsp) {
   // get value out of ram
   uint16_t adr = dsp->echoBufferAdr + dsp->echoBufferIndex;
   int16_t ramSample = dsp->apu->ram[adr] | (dsp->apu->ram[(adr + 1) & 0xffff] << 8);
-  dsp->firBufferL[dsp->firBufferIndex] = ramSample >> 1;
+  int16_t newL = ramSample >> 1;
   ramSample = dsp->apu->ram[(adr + 2) & 0xffff] | (dsp->apu->ram[(adr + 3) & 0xffff] << 8);
-  dsp->firBufferR[dsp->firBufferIndex] = ramSample >> 1;
-  // calculate FIR-sum
-  int sumL = 0, sumR = 0;
-  for(int i = 0; i < 8; i++) {
-    sumL += (dsp->firBufferL[(dsp->firBufferIndex + i + 1) & 0x7] * dsp->firValues[i]) >> 6;
-    sumR += (dsp->firBufferR[(dsp->firBufferIndex + i + 1) & 0x7] * dsp->firValues[i]) >> 6;
-    if(i == 6) {
-      // clip to 16-bit before last addition
-      sumL = clip16(sumL);
-      sumR = clip16(sumR);
-    }
-  }
+  int16_t newR = ramSample >> 1;
+  // calculate FIR-sum, the fir buffers hold every sample twice so that the 7 older samples are
+  // contiguous; they are read before the new sample gets stored, which is passed separately
+  int sumL, sumR;
+  dsp_applyFir(&dsp->firBufferL[dsp->firBufferIndex + 1], &dsp->firBufferR[dsp->firBufferIndex + 1], newL, newR, dsp->firValues, &sumL, &sumR);
+  dsp->firBufferL[dsp->firBufferIndex] = dsp->firBufferL[dsp->firBufferIndex + 8] = newL;
+  dsp->firBufferR[dsp->firBufferIndex] = dsp->firBufferR[dsp->firBufferIndex + 8] = newR;
   sumL = clamp16(sumL) & ~1;
   sumR = clamp16(sumR) & ~1;
   // apply master volume and modify output with sum
@@ -269,6 +449,10 @@ static void dsp_handleEcho(Dsp* dsp) {
     dsp->apu->ram[(adr + 1) & 0xffff] = echoL >> 8;
     dsp->apu->ram[(adr + 2) & 0xffff] = echoR & 0xff;
     dsp->apu->ram[(adr + 3) & 0xffff] = echoR >> 8;
+    dsp->apu->pageGenerations[adr >> 8]++;
+    dsp->apu->pageGenerations[((adr + 3) >> 8) & 0xff]++;
+    dsp->apu->ramPageEpochs[adr >> 8] = dsp->apu->snes->dirtyEpoch;
+    dsp->apu->ramPageEpochs[((adr + 3) >> 8) & 0xff] = dsp->apu->snes->dirtyEpoch;
   }
   // handle indexes
   if(dsp->echoBufferIndex == 0) {
@@ -280,46 +464,135 @@ static void dsp_handleEcho(Dsp* dsp) {
   }
 }
 
-static void dsp_cycleChannel(Dsp* dsp, int ch) {
-  // handle pitch counter
-  int pitch = dsp->channel[ch].pitch;
-  if(ch > 0 && dsp->channel[ch].pitchModulation) {
-    pitch += ((dsp->channel[ch - 1].sampleOut >> 5) * pitch) >> 10;
-  }
+static bool dsp_startChannel(Dsp* dsp, int ch, uint16_t* sampleAdr) {
   // get current brr header and get sample address
   dsp->channel[ch].brrHeader = dsp->apu->ram[dsp->channel[ch].decodeOffset];
   uint16_t samplePointer = dsp->dirPage + 4 * dsp->channel[ch].srcn;
   if(dsp->channel[ch].startDelay == 0) samplePointer += 2;
-  uint16_t sampleAdr = dsp->apu->ram[samplePointer] | (dsp->apu->ram[(samplePointer + 1) & 0xffff] << 8);
-  // handle starting of sample
+  *sampleAdr = dsp->apu->ram[samplePointer] | (dsp->apu->ram[(samplePointer + 1) & 0xffff] << 8);
+  // handle starting of sample, returns if the pitch is ignored this sample
   if(dsp->channel[ch].startDelay > 0) {
     if(dsp->channel[ch].startDelay == 5) {
       // first keyed on
-      dsp->channel[ch].decodeOffset = sampleAdr;
+      dsp->channel[ch].decodeOffset = *sampleAdr;
       dsp->channel[ch].blockOffset = 1;
-      dsp->channel[ch].bufferOffset = 0;
+      dsp->voices.bufferOffset[ch] = 0;
       dsp->channel[ch].brrHeader = 0;
     }
-    dsp->channel[ch].gain = 0;
+    dsp->voices.gain[ch] = 0;
     dsp->channel[ch].startDelay--;
-    dsp->channel[ch].pitchCounter = 0;
+    dsp->voices.pitchCounter[ch] = 0;
     if(dsp->channel[ch].startDelay > 0 && dsp->channel[ch].startDelay < 4) {
-      dsp->channel[ch].pitchCounter = 0x4000;
+      dsp->voices.pitchCounter[ch] = 0x4000;
     }
-    pitch = 0;
+    return true;
   }
-  // get sample
-  int sample = 0;
-  if(dsp->channel[ch].useNoise) {
-    sample = clip16(dsp->noiseSample * 2);
-  } else {
-    sample = dsp_getSample(dsp, ch);
+  return false;
+}
+
+#if defined(DSP_SIMD_SSE2)
+
+static inline void dsp_mul16(__m128i a, __m128i b, __m128i* lo, __m128i* hi) {
+  // full 32-bit products of 8 signed 16-bit lanes
+  __m128i l = _mm_mullo_epi16(a, b);
+  __m128i h = _mm_mulhi_epi16(a, b);
+  *lo = _mm_unpacklo_epi16(l, h);
+  *hi = _mm_unpackhi_epi16(l, h);
+}
+
+static inline __m128i dsp_interpolate4(__m128i* p) {
+  __m128i out = _mm_add_epi32(_mm_add_epi32(_mm_srai_epi32(p[0], 11), _mm_srai_epi32(p[1], 11)), _mm_srai_epi32(p[2], 11));
+  out = _mm_srai_epi32(_mm_slli_epi32(out, 16), 16); // clip16
+  return _mm_add_epi32(out, _mm_srai_epi32(p[3], 11));
+}
+
+#elif defined(DSP_SIMD_NEON)
+
+static inline int32x4_t dsp_interpolate4(int32x4_t* p) {
+  int32x4_t out = vaddq_s32(vaddq_s32(vshrq_n_s32(p[0], 11), vshrq_n_s32(p[1], 11)), vshrq_n_s32(p[2], 11));
+  out = vshrq_n_s32(vshlq_n_s32(out, 16), 16); // clip16
+  return vaddq_s32(out, vshrq_n_s32(p[3], 11));
+}
+
+#endif
+
+static void dsp_getVoiceSamples(Dsp* dsp, int16_t* samples) {
+  // interpolated (or noise) sample of each voice, multiplied by its gain
+#ifdef DSP_SIMD
+  if(dsp->activeVoices == 0) {
+    memset(samples, 0, 8 * sizeof(int16_t));
+    return;
   }
-  sample = ((sample * dsp->channel[ch].gain) >> 11) & ~1;
+  int16_t in[4][8], gauss[4][8], useNoise[8];
+  for(int ch = 0; ch < 8; ch++) {
+    int pos = (dsp->voices.pitchCounter[ch] >> 12) + dsp->voices.bufferOffset[ch];
+    int offset = (dsp->voices.pitchCounter[ch] >> 4) & 0xff;
+    for(int i = 0; i < 4; i++) {
+      in[i][ch] = dsp->voices.decodeBuffer[pos + i < 12 ? pos + i : pos + i - 12][ch];
+    }
+    gauss[0][ch] = gaussValues[0xff - offset];
+    gauss[1][ch] = gaussValues[0x1ff - offset];
+    gauss[2][ch] = gaussValues[0x100 + offset];
+    gauss[3][ch] = gaussValues[offset];
+    useNoise[ch] = dsp->channel[ch].useNoise ? -1 : 0;
+  }
+  int16_t noise = clip16(dsp->noiseSample * 2);
+#if defined(DSP_SIMD_SSE2)
+  __m128i lo[4], hi[4];
+  for(int i = 0; i < 4; i++) {
+    dsp_mul16(_mm_loadu_si128((__m128i*) gauss[i]), _mm_loadu_si128((__m128i*) in[i]), &lo[i], &hi[i]);
+  }
+  __m128i evenMask = _mm_set1_epi16(~1);
+  __m128i sample = _mm_and_si128(_mm_packs_epi32(dsp_interpolate4(lo), dsp_interpolate4(hi)), evenMask); // clamp16
+  __m128i noiseMask = _mm_loadu_si128((__m128i*) useNoise);
+  sample = _mm_or_si128(_mm_and_si128(noiseMask, _mm_set1_epi16(noise)), _mm_andnot_si128(noiseMask, sample));
+  __m128i gainLo, gainHi;
+  dsp_mul16(sample, _mm_loadu_si128((__m128i*) dsp->voices.gain), &gainLo, &gainHi);
+  sample = _mm_packs_epi32(_mm_srai_epi32(gainLo, 11), _mm_srai_epi32(gainHi, 11));
+  _mm_storeu_si128((__m128i*) samples, _mm_and_si128(sample, evenMask));
+#else
+  int32x4_t lo[4], hi[4];
+  for(int i = 0; i < 4; i++) {
+    int16x8_t g = vld1q_s16(gauss[i]), v = vld1q_s16(in[i]);
+    lo[i] = vmull_s16(vget_low_s16(g), vget_low_s16(v));
+    hi[i] = vmull_s16(vget_high_s16(g), vget_high_s16(v));
+  }
+  int16x8_t evenMask = vdupq_n_s16(~1);
+  int16x8_t sample = vandq_s16(vcombine_s16(vqmovn_s32(dsp_interpolate4(lo)), vqmovn_s32(dsp_interpolate4(hi))), evenMask);
+  sample = vbslq_s16(vreinterpretq_u16_s16(vld1q_s16(useNoise)), vdupq_n_s16(noise), sample);
+  int16x8_t gain = vreinterpretq_s16_u16(vld1q_u16(dsp->voices.gain));
+  int32x4_t gainLo = vshrq_n_s32(vmull_s16(vget_low_s16(sample), vget_low_s16(gain)), 11);
+  int32x4_t gainHi = vshrq_n_s32(vmull_s16(vget_high_s16(sample), vget_high_s16(gain)), 11);
+  vst1q_s16(samples, vandq_s16(vcombine_s16(vmovn_s32(gainLo), vmovn_s32(gainHi)), evenMask));
+#endif
+#else
+  for(int ch = 0; ch < 8; ch++) {
+    if(!(dsp->activeVoices & (1 << ch))) {
+      samples[ch] = 0; // zero gain
+      continue;
+    }
+    int sample = 0;
+    if(dsp->channel[ch].useNoise) {
+      sample = clip16(dsp->noiseSample * 2);
+    } else {
+      sample = dsp_getSample(dsp, ch);
+    }
+    samples[ch] = ((sample * dsp->voices.gain[ch]) >> 11) & ~1;
+  }
+#endif
+}
+
+static void dsp_updateChannel(Dsp* dsp, int ch, int sample, uint16_t sampleAdr, bool delayed) {
+  // handle pitch counter
+  int pitch = dsp->channel[ch].pitch;
+  if(ch > 0 && dsp->channel[ch].pitchModulation) {
+    pitch += ((dsp->voices.sampleOut[ch - 1] >> 5) * pitch) >> 10;
+  }
+  if(delayed) pitch = 0;
   // handle reset and release
   if(dsp->reset || (dsp->channel[ch].brrHeader & 0x03) == 1) {
     dsp->channel[ch].adsrState = 3; // go to release
-    dsp->channel[ch].gain = 0;
+    dsp->voices.gain[ch] = 0;
   }
   // handle keyon/keyoff
   if(dsp->evenCycle) {
@@ -333,12 +606,12 @@ static void dsp_cycleChannel(Dsp* dsp, int ch) {
       dsp->ram[0x7c] &= ~(1 << ch); // clear ENDx
     }
   }
-  // handle envelope
-  if(dsp->channel[ch].startDelay == 0) {
+  // handle envelope (which does not change for inactive voices)
+  if(dsp->channel[ch].startDelay == 0 && (dsp->activeVoices & (1 << ch))) {
     dsp_handleGain(dsp, ch);
   }
   // decode new brr samples if needed and update offsets
-  if(dsp->channel[ch].pitchCounter >= 0x4000) {
+  if(dsp->voices.pitchCounter[ch] >= 0x4000) {
     dsp_decodeBrr(dsp, ch);
     if(dsp->channel[ch].blockOffset >= 7) {
       if(dsp->channel[ch].brrHeader & 0x1) {
@@ -353,23 +626,171 @@ static void dsp_cycleChannel(Dsp* dsp, int ch) {
     }
   }
   // update pitch counter
-  dsp->channel[ch].pitchCounter &= 0x3fff;
-  dsp->channel[ch].pitchCounter += pitch;
-  if(dsp->channel[ch].pitchCounter > 0x7fff) dsp->channel[ch].pitchCounter = 0x7fff;
+  dsp->voices.pitchCounter[ch] &= 0x3fff;
+  dsp->voices.pitchCounter[ch] += pitch;
+  if(dsp->voices.pitchCounter[ch] > 0x7fff) dsp->voices.pitchCounter[ch] = 0x7fff;
   // set outputs
-  dsp->ram[(ch << 4) | 8] = dsp->channel[ch].gain >> 4;
+  dsp->ram[(ch << 4) | 8] = dsp->voices.gain[ch] >> 4;
   dsp->ram[(ch << 4) | 9] = sample >> 8;
-  dsp->channel[ch].sampleOut = sample;
-  dsp->sampleOutL = clamp16(dsp->sampleOutL + ((sample * dsp->channel[ch].volumeL) >> 7));
-  dsp->sampleOutR = clamp16(dsp->sampleOutR + ((sample * dsp->channel[ch].volumeR) >> 7));
-  if(dsp->channel[ch].echoEnable) {
-    dsp->echoOutL = clamp16(dsp->echoOutL + ((sample * dsp->channel[ch].volumeL) >> 7));
-    dsp->echoOutR = clamp16(dsp->echoOutR + ((sample * dsp->channel[ch].volumeR) >> 7));
+  dsp->voices.sampleOut[ch] = sample;
+  // once released to zero gain, a voice stays silent until keyed on again; it still decodes brr
+  // (for ENDx and its sample history) but skips the envelope, interpolation and mixing
+  if(
+    sample == 0 && dsp->channel[ch].adsrState == 3 && dsp->voices.gain[ch] == 0 &&
+    dsp->channel[ch].preclampGain == 0xfff8 && dsp->channel[ch].startDelay == 0 && !dsp->channel[ch].keyOn
+  ) {
+    dsp->activeVoices &= ~(1 << ch);
+  }
+}
+
+static int dsp_accumulate(const int32_t* values) {
+  // sums 8 voices, clamping after each one
+  int sum = 0;
+  for(int ch = 0; ch < 8; ch++) {
+    sum = clamp16(sum + values[ch]);
+  }
+  return sum;
+}
+
+#if defined(DSP_SIMD_SSE2)
+
+static inline int dsp_horizontalSum(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+static int dsp_mixChannel(__m128i sample, __m128i volume, __m128i mask) {
+  // (sample * volume) >> 7 for all voices in mask, accumulated with clamping
+  __m128i lo, hi;
+  dsp_mul16(_mm_and_si128(sample, mask), volume, &lo, &hi);
+  lo = _mm_srai_epi32(lo, 7);
+  hi = _mm_srai_epi32(hi, 7);
+  // if the magnitudes add up to less than 16 bits, no intermediate clamp can trigger
+  __m128i loSign = _mm_srai_epi32(lo, 31), hiSign = _mm_srai_epi32(hi, 31);
+  __m128i magnitude = _mm_add_epi32(
+    _mm_sub_epi32(_mm_xor_si128(lo, loSign), loSign), _mm_sub_epi32(_mm_xor_si128(hi, hiSign), hiSign)
+  );
+  if(dsp_horizontalSum(magnitude) <= 0x7fff) return dsp_horizontalSum(_mm_add_epi32(lo, hi));
+  int32_t values[8];
+  _mm_storeu_si128((__m128i*) values, lo);
+  _mm_storeu_si128((__m128i*) &values[4], hi);
+  return dsp_accumulate(values);
+}
+
+static int dsp_firSum(__m128i samples, __m128i taps) {
+  // sum of (sample * tap) >> 6 over the first 7 taps, clipped to 16 bits
+  __m128i lo, hi;
+  dsp_mul16(samples, taps, &lo, &hi);
+  lo = _mm_srai_epi32(lo, 6);
+  hi = _mm_srai_epi32(_mm_srli_si128(_mm_slli_si128(hi, 4), 4), 6); // drop the last tap
+  return clip16(dsp_horizontalSum(_mm_add_epi32(lo, hi)));
+}
+
+static void dsp_applyFir(const int16_t* left, const int16_t* right, int newL, int newR, const int8_t* firValues, int* sumL, int* sumR) {
+  __m128i taps = _mm_loadl_epi64((const __m128i*) firValues);
+  taps = _mm_srai_epi16(_mm_unpacklo_epi8(taps, taps), 8); // sign-extend
+  *sumL = dsp_firSum(_mm_loadu_si128((const __m128i*) left), taps) + ((newL * firValues[7]) >> 6);
+  *sumR = dsp_firSum(_mm_loadu_si128((const __m128i*) right), taps) + ((newR * firValues[7]) >> 6);
+}
+
+#elif defined(DSP_SIMD_NEON)
+
+static int dsp_mixChannel(int16x8_t sample, int16x8_t volume, int16x8_t mask) {
+  // (sample * volume) >> 7 for all voices in mask, accumulated with clamping
+  sample = vandq_s16(sample, mask);
+  int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(sample), vget_low_s16(volume)), 7);
+  int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(sample), vget_high_s16(volume)), 7);
+  // if the magnitudes add up to less than 16 bits, no intermediate clamp can trigger
+  int32x4_t magnitude = vaddq_s32(vabsq_s32(lo), vabsq_s32(hi));
+  int32x4_t sum = vaddq_s32(lo, hi);
+  int32x2_t m2 = vadd_s32(vget_low_s32(magnitude), vget_high_s32(magnitude));
+  int32x2_t s2 = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+  if(vget_lane_s32(vpadd_s32(m2, m2), 0) <= 0x7fff) return vget_lane_s32(vpadd_s32(s2, s2), 0);
+  int32_t values[8];
+  vst1q_s32(values, lo);
+  vst1q_s32(&values[4], hi);
+  return dsp_accumulate(values);
+}
+
+static int dsp_firSum(int16x8_t samples, int16x8_t taps) {
+  // sum of (sample * tap) >> 6 over the first 7 taps, clipped to 16 bits
+  int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(samples), vget_low_s16(taps)), 6);
+  int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(samples), vget_high_s16(taps)), 6);
+  int32x4_t sum = vaddq_s32(lo, vsetq_lane_s32(0, hi, 3)); // drop the last tap
+  int32x2_t s2 = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+  return clip16(vget_lane_s32(vpadd_s32(s2, s2), 0));
+}
+
+static void dsp_applyFir(const int16_t* left, const int16_t* right, int newL, int newR, const int8_t* firValues, int* sumL, int* sumR) {
+  int16x8_t taps = vmovl_s8(vld1_s8(firValues));
+  *sumL = dsp_firSum(vld1q_s16(left), taps) + ((newL * firValues[7]) >> 6);
+  *sumR = dsp_firSum(vld1q_s16(right), taps) + ((newR * firValues[7]) >> 6);
+}
+
+#else
+
+static void dsp_applyFir(const int16_t* left, const int16_t* right, int newL, int newR, const int8_t* firValues, int* sumL, int* sumR) {
+  // sum of (sample * tap) >> 6, clipped to 16 bits before adding the last tap (the new sample)
+  int l = 0, r = 0;
+  for(int i = 0; i < 7; i++) {
+    l += (left[i] * firValues[i]) >> 6;
+    r += (right[i] * firValues[i]) >> 6;
+  }
+  *sumL = clip16(l) + ((newL * firValues[7]) >> 6);
+  *sumR = clip16(r) + ((newR * firValues[7]) >> 6);
+}
+
+#endif
+
+static void dsp_mixVoices(Dsp* dsp) {
+  if(dsp->activeVoices == 0) return; // outputs were cleared at the start of the sample
+  int16_t echoMask[8];
+  for(int ch = 0; ch < 8; ch++) {
+    echoMask[ch] = dsp->channel[ch].echoEnable ? -1 : 0;
+  }
+#if defined(DSP_SIMD_SSE2)
+  __m128i sample = _mm_loadu_si128((__m128i*) dsp->voices.sampleOut);
+  __m128i volumeL = _mm_loadl_epi64((__m128i*) dsp->voices.volumeL);
+  __m128i volumeR = _mm_loadl_epi64((__m128i*) dsp->voices.volumeR);
+  volumeL = _mm_srai_epi16(_mm_unpacklo_epi8(volumeL, volumeL), 8); // sign-extend
+  volumeR = _mm_srai_epi16(_mm_unpacklo_epi8(volumeR, volumeR), 8);
+  __m128i all = _mm_set1_epi16(-1), echo = _mm_loadu_si128((__m128i*) echoMask);
+  dsp->sampleOutL = dsp_mixChannel(sample, volumeL, all);
+  dsp->sampleOutR = dsp_mixChannel(sample, volumeR, all);
+  dsp->echoOutL = dsp_mixChannel(sample, volumeL, echo);
+  dsp->echoOutR = dsp_mixChannel(sample, volumeR, echo);
+#elif defined(DSP_SIMD_NEON)
+  int16x8_t sample = vld1q_s16(dsp->voices.sampleOut);
+  int16x8_t volumeL = vmovl_s8(vld1_s8(dsp->voices.volumeL));
+  int16x8_t volumeR = vmovl_s8(vld1_s8(dsp->voices.volumeR));
+  int16x8_t all = vdupq_n_s16(-1), echo = vld1q_s16(echoMask);
+  dsp->sampleOutL = dsp_mixChannel(sample, volumeL, all);
+  dsp->sampleOutR = dsp_mixChannel(sample, volumeR, all);
+  dsp->echoOutL = dsp_mixChannel(sample, volumeL, echo);
+  dsp->echoOutR = dsp_mixChannel(sample, volumeR, echo);
+#else
+  int32_t mainL[8], mainR[8], echoL[8], echoR[8];
+  for(int ch = 0; ch < 8; ch++) {
+    if(!(dsp->activeVoices & (1 << ch))) {
+      mainL[ch] = mainR[ch] = echoL[ch] = echoR[ch] = 0;
+      continue;
+    }
+    int sample = dsp->voices.sampleOut[ch];
+    mainL[ch] = (sample * dsp->voices.volumeL[ch]) >> 7;
+    mainR[ch] = (sample * dsp->voices.volumeR[ch]) >> 7;
+    echoL[ch] = mainL[ch] & echoMask[ch];
+    echoR[ch] = mainR[ch] & echoMask[ch];
   }
+  dsp->sampleOutL = dsp_accumulate(mainL);
+  dsp->sampleOutR = dsp_accumulate(mainR);
+  dsp->echoOutL = dsp_accumulate(echoL);
+  dsp->echoOutR = dsp_accumulate(echoR);
+#endif
 }
 
 static void dsp_handleGain(Dsp* dsp, int ch) {
-  int newGain = dsp->channel[ch].gain;
+  int newGain = dsp->voices.gain[ch];
   int rate = 0;
   // handle gain mode
   if(dsp->channel[ch].adsrState == 3) { // release
@@ -413,38 +834,30 @@ static void dsp_handleGain(Dsp* dsp, int ch) {
     }
   }
   // store new value
-  if(dsp_checkCounter(dsp, rate)) dsp->channel[ch].gain = newGain;
+  if(dsp_checkCounter(dsp, rate)) dsp->voices.gain[ch] = newGain;
 }
 
+#ifndef DSP_SIMD
 static int16_t dsp_getSample(Dsp* dsp, int ch) {
-  int pos = (dsp->channel[ch].pitchCounter >> 12) + dsp->channel[ch].bufferOffset;
-  int offset = (dsp->channel[ch].pitchCounter >> 4) & 0xff;
-  int16_t news = dsp->channel[ch].decodeBuffer[(pos + 3) % 12];
-  int16_t olds = dsp->channel[ch].decodeBuffer[(pos + 2) % 12];
-  int16_t olders = dsp->channel[ch].decodeBuffer[(pos + 1) % 12];
-  int16_t oldests = dsp->channel[ch].decodeBuffer[pos % 12];
+  int pos = (dsp->voices.pitchCounter[ch] >> 12) + dsp->voices.bufferOffset[ch];
+  int offset = (dsp->voices.pitchCounter[ch] >> 4) & 0xff;
+  int16_t news = dsp->voices.decodeBuffer[(pos + 3) % 12][ch];
+  int16_t olds = dsp->voices.decodeBuffer[(pos + 2) % 12][ch];
+  int16_t olders = dsp->voices.decodeBuffer[(pos + 1) % 12][ch];
+  int16_t oldests = dsp->voices.decodeBuffer[pos % 12][ch];
   int out = (gaussValues[0xff - offset] * oldests) >> 11;
   out += (gaussValues[0x1ff - offset] * olders) >> 11;
   out += (gaussValues[0x100 + offset] * olds) >> 11;
   out = clip16(out) + ((gaussValues[offset] * news) >> 11);
   return clamp16(out) & ~1;
 }
+#endif
 
-static void dsp_decodeBrr(Dsp* dsp, int ch) {
-  int shift = dsp->channel[ch].brrHeader >> 4;
-  int filter = (dsp->channel[ch].brrHeader & 0xc) >> 2;
-  int bOff = dsp->channel[ch].bufferOffset;
-  int old = dsp->channel[ch].decodeBuffer[bOff == 0 ? 11 : bOff - 1] >> 1;
-  int older = dsp->channel[ch].decodeBuffer[bOff == 0 ? 10 : bOff - 2] >> 1;
-  uint8_t curByte = 0;
-  for(int i = 0; i < 4; i++) {
-    int s = 0;
-    if(i & 1) {
-      s = curByte & 0xf;
-    } else {
-      curByte = dsp->apu->ram[(dsp->channel[ch].decodeOffset + dsp->channel[ch].blockOffset + (i >> 1)) & 0xffff];
-      s = curByte >> 4;
-    }
+static void dsp_decodeNibbles(const uint8_t* bytes, int count, uint8_t header, int old, int older, int16_t* out, int stride) {
+  int shift = header >> 4;
+  int filter = (header & 0xc) >> 2;
+  for(int i = 0; i < count; i++) {
+    int s = (i & 1) ? bytes[i >> 1] & 0xf : bytes[i >> 1] >> 4;
     if(s > 7) s -= 16;
     if(shift <= 0xc) {
       s = (s << shift) >> 1;
@@ -456,12 +869,72 @@ static void dsp_decodeBrr(Dsp* dsp, int ch) {
       case 2: s += 2 * old + ((3 * -old) >> 5) - older + (older >> 4); break;
       case 3: s += 2 * old + ((13 * -old) >> 6) - older + ((3 * older) >> 4); break;
     }
-    dsp->channel[ch].decodeBuffer[bOff + i] = clamp16(s) * 2; // cuts off bit 15
+    out[i * stride] = clamp16(s) * 2; // cuts off bit 15
     older = old;
-    old = dsp->channel[ch].decodeBuffer[bOff + i] >> 1;
+    old = out[i * stride] >> 1;
   }
-  dsp->channel[ch].bufferOffset += 4;
-  if(dsp->channel[ch].bufferOffset >= 12) dsp->channel[ch].bufferOffset = 0;
+}
+
+static void dsp_clearBrrCache(Dsp* dsp) {
+  memset(dsp->brrCache, 0, sizeof(dsp->brrCache));
+  memset(dsp->brrCacheVoiceStamp, 0, sizeof(dsp->brrCacheVoiceStamp));
+  dsp->brrCacheStamp = 0;
+}
+
+static bool dsp_brrBlockValid(Dsp* dsp, DspBrrBlock* block, uint16_t adr) {
+  return block->stamp != 0 && block->adr == adr &&
+    block->pageGenerations[0] == dsp->apu->pageGenerations[adr >> 8] &&
+    block->pageGenerations[1] == dsp->apu->pageGenerations[((adr + 8) >> 8) & 0xff];
+}
+
+static const int16_t* dsp_getCachedBrr(Dsp* dsp, int ch, int old, int older) {
+  // returns the next 4 samples of the voice from the cache, or NULL if they have to be decoded from ram
+  DspChannel* channel = &dsp->channel[ch];
+  if(!(channel->blockOffset & 1) || channel->blockOffset > 7) return NULL;
+  uint16_t adr = channel->decodeOffset;
+  DspBrrBlock* block = NULL;
+  if(channel->blockOffset == 1) {
+    // start of a block, look it up and decode it as a whole if not present
+    if((channel->brrHeader & 0xc) == 0) old = older = 0; // unfiltered, history is not used
+    uint32_t hash = adr * 0x9e3779b1u ^ (uint16_t) old * 0x85ebca6bu ^ (uint16_t) older * 0xc2b2ae35u;
+    int index = (hash ^ (hash >> 15)) & (DSP_BRR_CACHE_SIZE - 1);
+    block = &dsp->brrCache[index];
+    if(!dsp_brrBlockValid(dsp, block, adr) || block->old != old || block->older != older) {
+      uint8_t bytes[8];
+      for(int i = 0; i < 8; i++) bytes[i] = dsp->apu->ram[(adr + 1 + i) & 0xffff];
+      dsp_decodeNibbles(bytes, 16, channel->brrHeader, old, older, block->samples, 1);
+      block->adr = adr;
+      block->old = old;
+      block->older = older;
+      block->pageGenerations[0] = dsp->apu->pageGenerations[adr >> 8];
+      block->pageGenerations[1] = dsp->apu->pageGenerations[((adr + 8) >> 8) & 0xff];
+      if(++dsp->brrCacheStamp == 0) dsp->brrCacheStamp = 1;
+      block->stamp = dsp->brrCacheStamp;
+    }
+    dsp->brrCacheEntry[ch] = index;
+    dsp->brrCacheVoiceStamp[ch] = block->stamp;
+  } else {
+    // continue in the block the voice started, if it is still there and the ram is unchanged
+    block = &dsp->brrCache[dsp->brrCacheEntry[ch]];
+    if(block->stamp != dsp->brrCacheVoiceStamp[ch] || !dsp_brrBlockValid(dsp, block, adr)) return NULL;
+  }
+  return &block->samples[(channel->blockOffset >> 1) * 4];
+}
+
+static void dsp_decodeBrr(Dsp* dsp, int ch) {
+  int bOff = dsp->voices.bufferOffset[ch];
+  int old = dsp->voices.decodeBuffer[bOff == 0 ? 11 : bOff - 1][ch] >> 1;
+  int older = dsp->voices.decodeBuffer[bOff == 0 ? 10 : bOff - 2][ch] >> 1;
+  const int16_t* cached = dsp_getCachedBrr(dsp, ch, old, older);
+  if(cached != NULL) {
+    for(int i = 0; i < 4; i++) dsp->voices.decodeBuffer[bOff + i][ch] = cached[i];
+  } else {
+    uint16_t adr = dsp->channel[ch].decodeOffset + dsp->channel[ch].blockOffset;
+    uint8_t bytes[2] = {dsp->apu->ram[adr], dsp->apu->ram[(adr + 1) & 0xffff]};
+    dsp_decodeNibbles(bytes, 4, dsp->channel[ch].brrHeader, old, older, &dsp->voices.decodeBuffer[bOff][ch], 8);
+  }
+  dsp->voices.bufferOffset[ch] += 4;
+  if(dsp->voices.bufferOffset[ch] >= 12) dsp->voices.bufferOffset[ch] = 0;
 }
 
 static void dsp_handleNoise(Dsp* dsp) {
@@ -479,11 +952,11 @@ void dsp_write(Dsp* dsp, uint8_t adr, uint8_t val) {
   int ch = adr >> 4;
   switch(adr) {
     case 0x00: case 0x10: case 0x20: case 0x30: case 0x40: case 0x50: case 0x60: case 0x70: {
-      dsp->channel[ch].volumeL = val;
+      dsp->voices.volumeL[ch] = val;
       break;
     }
     case 0x01: case 0x11: case 0x21: case 0x31: case 0x41: case 0x51: case 0x61: case 0x71: {
-      dsp->channel[ch].volumeR = val;
+      dsp->voices.volumeR[ch] = val;
       break;
     }
     case 0x02: case 0x12: case 0x22: case 0x32: case 0x42: case 0x52: case 0x62: case 0x72: {
@@ -537,6 +1010,7 @@ void dsp_write(Dsp* dsp, uint8_t adr, uint8_t val) {
       for(int i = 0; i < 8; i++) {
         dsp->channel[i].keyOn = val & (1 << i);
       }
+      dsp->activeVoices |= val;
       break;
     }
     case 0x5c: {
@@ -598,15 +1072,106 @@ void dsp_write(Dsp* dsp, uint8_t adr, uint8_t val) {
   dsp->ram[adr] = val;
 }
 
+static int dsp_dot32(const int16_t* a, const int16_t* b) {
+#if defined(DSP_SIMD_SSE2)
+  __m128i sum = _mm_setzero_si128();
+  for(int i = 0; i < 32; i += 8) {
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i*) &a[i]), _mm_loadu_si128((const __m128i*) &b[i])));
+  }
+  return dsp_horizontalSum(sum);
+#elif defined(DSP_SIMD_NEON)
+  int32x4_t sum = vdupq_n_s32(0);
+  for(int i = 0; i < 32; i += 4) {
+    sum = vmlal_s16(sum, vld1_s16(&a[i]), vld1_s16(&b[i]));
+  }
+  int32x2_t s2 = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+  return vget_lane_s32(vpadd_s32(s2, s2), 0);
+#else
+  int sum = 0;
+  for(int i = 0; i < 32; i++) sum += a[i] * b[i];
+  return sum;
+#endif
+}
+
+static uint32_t dsp_resample(Dsp* dsp, int16_t* sampleData, int samples, uint32_t pos, uint32_t step) {
+  // filter samples from the samplebuffer at 16.16 position pos, advancing by step, returns the new position
+  int16_t left[32], right[32];
+  for(int i = 0; i < samples; i++) {
+    int start = (pos >> 16) - 15;
+    for(int j = 0; j < 32; j++) {
+      left[j] = dsp->sampleBuffer[((start + j) & 0x7ff) * 2];
+      right[j] = dsp->sampleBuffer[((start + j) & 0x7ff) * 2 + 1];
+    }
+    // interpolate between the two nearest phases of the filter
+    int phase = (pos >> 10) & 0x3f;
+    int weight = pos & 0x3ff;
+    int l0 = dsp_dot32(left, sincValues[phase]), l1 = dsp_dot32(left, sincValues[phase + 1]);
+    int r0 = dsp_dot32(right, sincValues[phase]), r1 = dsp_dot32(right, sincValues[phase + 1]);
+    int l = l0 + (int) (((int64_t) (l1 - l0) * weight) >> 10);
+    int r = r0 + (int) (((int64_t) (r1 - r0) * weight) >> 10);
+    sampleData[i * 2] = clamp16((l + 0x2000) >> 14);
+    sampleData[i * 2 + 1] = clamp16((r + 0x2000) >> 14);
+    pos = (pos + step) & 0x7ffffff;
+  }
+  return pos;
+}
+
 void dsp_getSamples(Dsp* dsp, int16_t* sampleData, int samplesPerFrame) {
-  // resample from about 534 / 641 samples per frame to wanted value
-  float wantedSamples = dsp->sampleCount;
+  // resample the samples generated since the last call (about 534 / 641 per frame) to wanted value,
+  // the read position carries over between calls so that the ratio can change from frame to frame
+  // (the frontend varies samplesPerFrame slightly to keep its audio queue filled)
+  int available = dsp->sampleCount;
   dsp->sampleCount = 0;
-  double adder = wantedSamples / samplesPerFrame;
-  double location = dsp->lastFrameBoundary - wantedSamples;
-  for(int i = 0; i < samplesPerFrame; i++) {
-    sampleData[i * 2] = dsp->sampleBuffer[(((int) location) & 0x7ff) * 2];
-    sampleData[i * 2 + 1] = dsp->sampleBuffer[(((int) location) & 0x7ff) * 2 + 1];
-    location += adder;
+  // read 16 samples behind the frame boundary, the filter needs 16 samples past the read position
+  uint32_t end = ((dsp->lastFrameBoundary - 16) & 0x7ff) << 16;
+  uint32_t pos = atomic_load_explicit(&dsp->resamplePos, memory_order_relaxed);
+  uint32_t distance = (end - pos) & 0x7ffffff;
+  if(available > 0x700) available = 0x700;
+  if(distance > (uint32_t) (available + 32) << 16 || distance + (32 << 16) < (uint32_t) available << 16) {
+    // lost track (first call, reset, state load), restart at the start of this frame
+    pos = (end - (available << 16)) & 0x7ffffff;
+    distance = available << 16;
+  }
+  pos = dsp_resample(dsp, sampleData, samplesPerFrame, pos, distance / samplesPerFrame);
+  atomic_store_explicit(&dsp->resamplePos, pos, memory_order_relaxed);
+}
+
+int dsp_getQueuedSamples(Dsp* dsp) {
+  // samples in the ring that dsp_pullSamples has not yet read (past the filter delay)
+  uint32_t written = atomic_load_explicit(&dsp->sampleWritten, memory_order_acquire);
+  uint32_t pos = atomic_load_explicit(&dsp->resamplePos, memory_order_relaxed);
+  int queued = (((((written - 16) & 0x7ff) << 16) - pos) & 0x7ffffff) >> 16;
+  // more than dsp_pullSamples plays (it skips ahead then, as after a reset), report it as full
+  return queued > 0x700 ? 0x700 : queued;
+}
+
+void dsp_pullSamples(Dsp* dsp, int16_t* sampleData, int samples, double ratio) {
+  // single consumer side of the samplebuffer: resample at ratio (source samples per output sample),
+  // may run on an audio thread concurrently with the emulation, which only publishes sampleWritten
+  uint32_t written = atomic_load_explicit(&dsp->sampleWritten, memory_order_acquire);
+  uint32_t end = ((written - 16) & 0x7ff) << 16;
+  uint32_t pos = atomic_load_explicit(&dsp->resamplePos, memory_order_relaxed);
+  uint32_t distance = (end - pos) & 0x7ffffff;
+  if(distance > 0x700 << 16) {
+    // reader fell behind by almost the whole ring (or the dsp got reset), skip to the newest samples
+    pos = end;
+    distance = 0;
   }
+  uint32_t step = ratio * 0x10000;
+  int available = step == 0 ? samples : (int) (distance / step);
+  int count = samples < available ? samples : available;
+  pos = dsp_resample(dsp, sampleData, count, pos, step);
+  // ran out of samples, emulation is late or paused
+  memset(sampleData + count * 2, 0, (samples - count) * 4);
+  atomic_store_explicit(&dsp->resamplePos, pos, memory_order_release);
+}
+
+void dsp_copyOutput(Dsp* dsp, Dsp* src) {
+  // copies the sample ring of src (its producer being the caller), which can have a consumer running
+  memcpy(dsp->sampleBuffer, src->sampleBuffer, sizeof(dsp->sampleBuffer));
+  dsp->sampleOffset = src->sampleOffset;
+  dsp->sampleCount = src->sampleCount;
+  dsp->lastFrameBoundary = src->lastFrameBoundary;
+  atomic_store(&dsp->sampleWritten, atomic_load(&src->sampleWritten));
+  atomic_store(&dsp->resamplePos, atomic_load(&src->resamplePos));
 }
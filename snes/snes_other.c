@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
 
 #include "snes.h"
@@ -164,12 +165,41 @@ void snes_setPixels(Snes* snes, uint8_t* pixelData) {
   ppu_putPixels(snes->ppu, pixelData);
 }
 
+void snes_setIndexedOutput(Snes* snes, bool enabled) {
+  // render lines without color math as 8-bit indices, see snes_setPixelsIndexed
+  snes->ppu->indexedOutput = enabled;
+}
+
+void snes_setPixelsIndexed(Snes* snes, uint8_t* pixelData, uint16_t* paletteData, uint8_t* lineData) {
+  // pixelData has the same size and pitch as for snes_setPixels, lineData is 240 bytes, paletteData
+  // 2 * PPU_PALETTE_SLOTS * 256 entries; line y holds RGB565 if lineData[y] == PPU_LINE_RGB565, else
+  // 256 indices into paletteData[lineData[y] * 256]
+  ppu_putPixelsIndexed(snes->ppu, pixelData, paletteData, lineData);
+}
+
+void snes_setFastIpl(Snes* snes, bool enabled) {
+  // run the apu boot rom's upload loops natively (exact), and uploads from the cpu's standard upload loop in
+  // bulk (with the nominal time per byte, see snes_runUpload); on by default
+  snes->apu->fastIpl = enabled;
+}
+
 void snes_setSamples(Snes* snes, int16_t* sampleData, int samplesPerFrame) {
   // size is 2 (int16) * 2 (stereo) * samplesPerFrame
   // sets samples in the sampleData
   dsp_getSamples(snes->apu->dsp, sampleData, samplesPerFrame);
 }
 
+int snes_getQueuedSamples(Snes* snes) {
+  // number of generated samples (at SNES_SAMPLE_RATE) not yet pulled by snes_pullSamples
+  return dsp_getQueuedSamples(snes->apu->dsp);
+}
+
+void snes_pullSamples(Snes* snes, int16_t* sampleData, int samples, double ratio) {
+  // alternative to snes_setSamples, safe to call from an audio callback while another thread runs
+  // frames; fills sampleData with samples (stereo) consuming ratio generated samples per sample
+  dsp_pullSamples(snes->apu->dsp, sampleData, samples, ratio);
+}
+
 int snes_saveBattery(Snes* snes, uint8_t* data) {
   int size = 0;
   cart_handleBattery(snes->cart, true, data, &size);
@@ -177,41 +207,101 @@ int snes_saveBattery(Snes* snes, uint8_t* data) {
 }
 
 bool snes_loadBattery(Snes* snes, uint8_t* data, int size) {
+  snes->allDirtyEpoch = snes->dirtyEpoch;
   return cart_handleBattery(snes->cart, false, data, &size);
 }
 
 int snes_saveState(Snes* snes, uint8_t* data) {
-  StateHandler* sh = sh_init(true, NULL, 0);
+  // writes straight into data (which has to hold snes_saveState(snes, NULL) bytes), or only counts with NULL
+  StateHandler sh;
+  sh_init(&sh, true, data, data != NULL ? INT_MAX : 0);
   uint32_t id = 0x4653534c; // 'LSSF' LakeSnes State File
   uint32_t version = stateVersion;
-  sh_handleInts(sh, &id, &version, &version, NULL); // second version to be overridden by length
-  cart_handleTypeState(snes->cart, sh);
+  sh_handleInts(&sh, &id, &version, &version, NULL); // second version to be overridden by length
+  cart_handleTypeState(snes->cart, &sh);
   // save data
-  snes_handleState(snes, sh);
+  snes_handleState(snes, &sh);
   // store
-  sh_placeInt(sh, 8, sh->offset);
-  if(data != NULL) memcpy(data, sh->data, sh->offset);
-  int size = sh->offset;
-  sh_free(sh);
-  return size;
+  sh_placeInt(&sh, 8, sh.offset);
+  return sh.offset;
 }
 
 bool snes_loadState(Snes* snes, uint8_t* data, int size) {
-  StateHandler* sh = sh_init(false, data, size);
+  StateHandler sh;
+  sh_init(&sh, false, data, size);
   uint32_t id = 0, version = 0, length = 0;
-  sh_handleInts(sh, &id, &version, &length, NULL);
-  bool cartMatch = cart_handleTypeState(snes->cart, sh);
+  sh_handleInts(&sh, &id, &version, &length, NULL);
+  bool cartMatch = cart_handleTypeState(snes->cart, &sh);
   if(id != 0x4653534c || version != stateVersion || length != size || !cartMatch) {
-    sh_free(sh);
     return false;
   }
   // load data
-  snes_handleState(snes, sh);
-  // finish
-  sh_free(sh);
+  snes_handleState(snes, &sh);
+  snes->stateEpoch = snes->dirtyEpoch;
   return true;
 }
 
+void snes_runFrameAhead(Snes* snes, int frames, uint8_t* stateData) {
+  // run-ahead: runs a frame (for its audio), then that many more with the same input of which only the last
+  // is rendered, and goes back to the state after the first; hides as many frames of the game's input lag.
+  // stateData has to hold snes_saveState(snes, NULL) bytes
+  if(frames <= 0) {
+    snes_runFrame(snes);
+    return;
+  }
+  snes->ppu->skipRender = true;
+  snes_runFrame(snes);
+  int size = snes_saveState(snes, stateData);
+  snes->apu->dsp->skipOutput = true;
+  for(int i = 0; i < frames; i++) {
+    snes->ppu->skipRender = i < frames - 1;
+    snes_runFrame(snes);
+  }
+  snes->apu->dsp->skipOutput = false;
+  snes_loadState(snes, stateData, size);
+}
+
+uint32_t snes_newEpoch(Snes* snes) {
+  // starts a new epoch and returns it; snes_getDirtyPages(..., since = it, ...) then gives the pages
+  // written from here on, so an incremental snapshot taken now only has to copy those next time
+  return ++snes->dirtyEpoch;
+}
+
+uint8_t* snes_getArea(Snes* snes, int area, int* size) {
+  switch(area) {
+    case SNES_AREA_WRAM: *size = sizeof(snes->ram); return snes->ram;
+    case SNES_AREA_VRAM: *size = sizeof(snes->ppu->vram); return (uint8_t*) snes->ppu->vram;
+    case SNES_AREA_ARAM: *size = sizeof(snes->apu->ram); return snes->apu->ram;
+    case SNES_AREA_CARTRAM: *size = snes->cart->ramSize; return snes->cart->ram;
+  }
+  *size = 0;
+  return NULL;
+}
+
+int snes_getDirtyPages(Snes* snes, int area, uint32_t since, uint8_t* bitmap) {
+  // sets bit (page & 7) of bitmap[page >> 3] for the SNES_PAGE_SIZE pages of the area that were written in
+  // epoch since or later (and clears the others), returns the amount of pages; bitmap can be NULL to only
+  // get the amount
+  int size = 0;
+  snes_getArea(snes, area, &size);
+  int pages = (size + SNES_PAGE_SIZE - 1) / SNES_PAGE_SIZE;
+  if(bitmap == NULL) return pages;
+  const uint32_t* epochs = NULL;
+  int tracked = pages;
+  switch(area) {
+    case SNES_AREA_WRAM: epochs = snes->ramPageEpochs; break;
+    case SNES_AREA_VRAM: epochs = snes->ppu->vramPageEpochs; break;
+    case SNES_AREA_ARAM: epochs = snes->apu->ramPageEpochs; break;
+    case SNES_AREA_CARTRAM: epochs = snes->cart->ramPageEpochs; if(tracked > 0x200) tracked = 0x200; break;
+  }
+  bool all = snes->allDirtyEpoch >= since || (area != SNES_AREA_CARTRAM && snes->stateEpoch >= since);
+  memset(bitmap, 0, (pages + 7) / 8);
+  for(int i = 0; i < pages; i++) {
+    if(all || i >= tracked || epochs[i] >= since) bitmap[i >> 3] |= 1 << (i & 7);
+  }
+  return pages;
+}
+
 static void readHeader(const uint8_t* data, int length, int location, CartHeader* header) {
   // read name, TODO: non-ASCII names?
   for(int i = 0; i < 21; i++) {
@@ -61,18 +61,23 @@ static const int spriteSizes[8][2] = {
 };
 
 // caches & luts to reduce cpu load
-static uint32_t bright_lut[0x10];
-static uint32_t bright_now;
-static uint8_t color_clamp_lut[0x20 * 3];
-static uint8_t *color_clamp_lut_i20 = &color_clamp_lut[0x20];
-
-static int layerCache[4] = { -1, -1, -1, -1 };
-static uint16_t bg_pixel_buf[4];
-static uint8_t bg_prio_buf[4];
-static bool bg_window_state[6]; // 0-3 (bg) 4 (spr) 5 (colorwind)
+static const uint32_t bright_lut[0x10] = { // (i * 0x10000) / 15
+  0, 4369, 8738, 13107, 17476, 21845, 26214, 30583, 34952, 39321, 43690, 48059, 52428, 56797, 61166, 65536
+};
+static const uint8_t color_clamp_lut[0x20 * 3] = { // clamps i - 0x20 to 0 - 0x1f
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+  0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f,
+  0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f
+};
+static const uint8_t* const color_clamp_lut_i20 = &color_clamp_lut[0x20];
 
 static void ppu_handlePixel(Ppu* ppu, int x, int y);
 static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b);
+static inline int ppu_findPixel(Ppu* ppu, int actMode, int x, int y, bool sub, int* pixelOut);
+static bool ppu_canIndexLine(Ppu* ppu);
+static int ppu_getPaletteSlot(Ppu* ppu);
 static uint16_t ppu_getOffsetValue(Ppu* ppu, int col, int row);
 static inline void ppu_getPixelForBgLayer(Ppu* ppu, int x, int y, int layer);
 static void ppu_handleOPT(Ppu* ppu, int layer, int* lx, int* ly);
@@ -82,43 +87,17 @@ static bool ppu_getWindowState(Ppu* ppu, int layer, int x);
 static void ppu_evaluateSprites(Ppu* ppu, int line);
 static uint16_t ppu_getVramRemap(Ppu* ppu);
 
-#ifdef TARGET_GNW
-static Ppu g_static_ppu;
-#endif
-
-Ppu* ppu_init(Snes* snes) {
-#ifndef TARGET_GNW
-  Ppu* ppu = malloc(sizeof(Ppu));
-#else
-  Ppu* ppu = &g_static_ppu;
-#endif
+void ppu_init(Ppu* ppu, Snes* snes) {
   ppu->snes = snes;
-  return ppu;
+  ppu->indexedOutput = false;
+  ppu->skipRender = false;
+  ppu->shownEvenFrame = false;
+  ppu->shownOverscan = false;
+  ppu->shownInterlace = false;
 }
 
-#ifndef TARGET_GNW
-void ppu_free(Ppu* ppu) {
-  free(ppu);
-}
-#endif
-
 void ppu_reset(Ppu* ppu) {
-  // create brightness and color clamp LUTs (rendering opti)
-  for (int i = 0; i < 0x10; i++) {
-    bright_lut[i] = (i * 0x10000) / 15;
-  }
-  for (int i = 0; i < 0x20*3; i++) {
-    if (i < 0x20) {
-      color_clamp_lut[i] = 0;
-    }
-    if (i >= 0x20 && i <= 0x3f) {
-      color_clamp_lut[i] = i - 0x20; // 0 - 1f
-    }
-    if (i >= 0x40) {
-      color_clamp_lut[i] = 0x1f;
-    }
-  }
-  bright_now = bright_lut[0xf]; // default
+  ppu->brightNow = bright_lut[0xf]; // default
 
   memset(ppu->vram, 0, sizeof(ppu->vram));
   ppu->vramPointer = 0;
@@ -215,6 +194,9 @@ void ppu_reset(Ppu* ppu) {
   ppu->ppu1openBus = 0;
   ppu->ppu2openBus = 0;
   memset(ppu->pixelBuffer, 0, sizeof(ppu->pixelBuffer));
+  ppu->paletteDirty = true;
+  memset(ppu->paletteCount, 0, sizeof(ppu->paletteCount));
+  memset(ppu->lineFormat, PPU_LINE_RGB565, sizeof(ppu->lineFormat));
 }
 
 void ppu_handleState(Ppu* ppu, StateHandler* sh) {
@@ -271,6 +253,8 @@ void ppu_handleState(Ppu* ppu, StateHandler* sh) {
   sh_handleByteArray(sh, ppu->highOam, 0x20);
   sh_handleByteArray(sh, ppu->objPixelBuffer, 256);
   sh_handleByteArray(sh, ppu->objPriorityBuffer, 256);
+  ppu->brightNow = bright_lut[ppu->brightness];
+  ppu->paletteDirty = true;
 }
 
 bool ppu_checkOverscan(Ppu* ppu) {
@@ -287,6 +271,11 @@ void ppu_handleVblank(Ppu* ppu) {
     ppu->oamSecondWrite = false;
   }
   ppu->frameInterlace = ppu->interlace; // set if we have a interlaced frame
+  if(!ppu->skipRender) {
+    ppu->shownEvenFrame = ppu->evenFrame;
+    ppu->shownOverscan = ppu->frameOverscan;
+    ppu->shownInterlace = ppu->frameInterlace;
+  }
 }
 
 void ppu_handleFrameStart(Ppu* ppu) {
@@ -295,6 +284,8 @@ void ppu_handleFrameStart(Ppu* ppu) {
   ppu->rangeOver = false;
   ppu->timeOver = false;
   ppu->evenFrame = !ppu->evenFrame;
+  ppu->paletteCount[ppu->evenFrame ? 0 : 1] = 0;
+  ppu->paletteDirty = true;
 }
 
 void ppu_runLine(Ppu* ppu, int line) {
@@ -302,30 +293,88 @@ void ppu_runLine(Ppu* ppu, int line) {
   // evaluate sprites
   memset(ppu->objPixelBuffer, 0, sizeof(ppu->objPixelBuffer));
   if(!ppu->forcedBlank) ppu_evaluateSprites(ppu, line - 1);
-  // NOTE: if frameskipping, return here. (ppu_evaluateSprites() must run regardless)
-  // actual line
+  // the mode 7 starts are part of the state, so they are kept up to date as well
   if(ppu->mode == 7) ppu_calculateMode7Starts(ppu, line);
-  layerCache[0] = layerCache[1] = layerCache[2] = layerCache[3] = -1;
+  // frameskipping returns here (ppu_evaluateSprites() must run regardless)
+  if(ppu->skipRender) return;
+  // actual line
+  ppu->layerCache[0] = ppu->layerCache[1] = ppu->layerCache[2] = ppu->layerCache[3] = -1;
+  int row = (line - 1) + (ppu->evenFrame ? 0 : 239);
+  if(ppu->indexedOutput && ppu_canIndexLine(ppu)) {
+    int slot = ppu_getPaletteSlot(ppu);
+    if(slot >= 0) {
+      // every pixel is a plain cgram entry, store the indices only
+      int actMode = ppu->mode == 1 && ppu->bg3priority ? 8 : ppu->mode;
+      actMode = ppu->mode == 7 && ppu->m7extBg ? 9 : actMode;
+      uint8_t* dest = &ppu->pixelBuffer[row * 512];
+      for(int x = 0; x < 256; x++) {
+        for(int i = 0; i < 5; i++) ppu->bgWindowState[i] = ppu_getWindowState(ppu, i, x);
+        int pixel = 0;
+        ppu_findPixel(ppu, actMode, x, line, false, &pixel);
+        dest[x] = pixel;
+      }
+      ppu->lineFormat[row] = slot;
+      return;
+    }
+  }
+  ppu->lineFormat[row] = PPU_LINE_RGB565;
   for(int x = 0; x < 256; x++) {
     ppu_handlePixel(ppu, x, line);
   }
 }
 
+static bool ppu_canIndexLine(Ppu* ppu) {
+  // true if no pixel on this line can end up as anything but its (brightness-adjusted) cgram color
+  if(ppu->forcedBlank || ppu->pseudoHires || ppu->mode == 5 || ppu->mode == 6) return false;
+  if(ppu->clipMode != 0) return false;
+  if(ppu->directColor && (ppu->mode == 3 || ppu->mode == 4 || ppu->mode == 7)) return false;
+  if(ppu->preventMathMode != 3) {
+    for(int i = 0; i < 6; i++) {
+      if(ppu->mathEnabled[i]) return false;
+    }
+  }
+  return true;
+}
+
+static inline uint16_t ppu_toRgb565(int r, int g, int b) {
+  return ((r & 0x1F) << 11) |  // Red: 5 bits
+         ((g & 0x1F) << 6) |    // Green: 6 bits (shifted by 6 to leave room for blue)
+         (b & 0x1F);            // Blue: 5 bits
+}
+
+static int ppu_getPaletteSlot(Ppu* ppu) {
+  // returns the palette for the current cgram and brightness, or -1 if this frame ran out of slots
+  int frame = ppu->evenFrame ? 0 : 1;
+  if(ppu->paletteDirty) {
+    if(ppu->paletteCount[frame] == PPU_PALETTE_SLOTS) return -1;
+    uint16_t* palette = ppu->palettes[frame][ppu->paletteCount[frame]++];
+    for(int i = 0; i < 256; i++) {
+      uint16_t color = ppu->cgram[i];
+      int r = ((color & 0x1f) * ppu->brightNow) >> 16;
+      int g = (((color >> 5) & 0x1f) * ppu->brightNow) >> 16;
+      int b = (((color >> 10) & 0x1f) * ppu->brightNow) >> 16;
+      palette[i] = ppu_toRgb565(r, g, b);
+    }
+    ppu->paletteDirty = false;
+  }
+  return frame * PPU_PALETTE_SLOTS + ppu->paletteCount[frame] - 1;
+}
+
 static void ppu_handlePixel(Ppu* ppu, int x, int y) {
   int r = 0, r2 = 0;
   int g = 0, g2 = 0;
   int b = 0, b2 = 0;
   bool halfColor = ppu->halfColor;
   // cache for speed-up
-  bg_window_state[0] = ppu_getWindowState(ppu, 0, x);
-  bg_window_state[1] = ppu_getWindowState(ppu, 1, x);
-  bg_window_state[2] = ppu_getWindowState(ppu, 2, x);
-  bg_window_state[3] = ppu_getWindowState(ppu, 3, x);
-  bg_window_state[4] = ppu_getWindowState(ppu, 4, x);
-  bg_window_state[5] = ppu_getWindowState(ppu, 5, x);
+  ppu->bgWindowState[0] = ppu_getWindowState(ppu, 0, x);
+  ppu->bgWindowState[1] = ppu_getWindowState(ppu, 1, x);
+  ppu->bgWindowState[2] = ppu_getWindowState(ppu, 2, x);
+  ppu->bgWindowState[3] = ppu_getWindowState(ppu, 3, x);
+  ppu->bgWindowState[4] = ppu_getWindowState(ppu, 4, x);
+  ppu->bgWindowState[5] = ppu_getWindowState(ppu, 5, x);
   if(!ppu->forcedBlank) {
     int mainLayer = ppu_getPixel(ppu, x, y, false, &r, &g, &b);
-    bool colorWindowState = bg_window_state[5];
+    bool colorWindowState = ppu->bgWindowState[5];
     bool bClipIfHires = false;
     if(
       ppu->clipMode == 3 ||
@@ -405,18 +454,13 @@ static void ppu_handlePixel(Ppu* ppu, int x, int y) {
 
   // Apply brightness to RGB values
   if (!ppu->forcedBlank) {
-    r = (r * bright_now) >> 16;
-    g = (g * bright_now) >> 16;
-    b = (b * bright_now) >> 16;
+    r = (r * ppu->brightNow) >> 16;
+    g = (g * ppu->brightNow) >> 16;
+    b = (b * ppu->brightNow) >> 16;
   }
 
-  // Convert to RGB565 with proper scaling
-  uint16_t rgb565 = ((r & 0x1F) << 11) |  // Red: 5 bits
-                    ((g & 0x1F) << 6) |    // Green: 6 bits (shifted by 6 to leave room for blue)
-                    (b & 0x1F);            // Blue: 5 bits
-
   // Store as RGB565 word
-  *dest = rgb565;
+  *dest = ppu_toRgb565(r, g, b);
 }
 
 static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b) {
@@ -424,6 +468,24 @@ static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b
   // returns which layer it is: 0-3 for bg layer, 4 or 6 for sprites (depending on palette), 5 for backdrop
   int actMode = ppu->mode == 1 && ppu->bg3priority ? 8 : ppu->mode;
   actMode = ppu->mode == 7 && ppu->m7extBg ? 9 : actMode;
+  int pixel = 0;
+  int layer = ppu_findPixel(ppu, actMode, x, y, sub, &pixel);
+  if(ppu->directColor && layer < 4 && bitDepthsPerMode[actMode][layer] == 8) {
+    *r = ((pixel & 0x7) << 2) | ((pixel & 0x100) >> 7);
+    *g = ((pixel & 0x38) >> 1) | ((pixel & 0x200) >> 8);
+    *b = ((pixel & 0xc0) >> 3) | ((pixel & 0x400) >> 8);
+  } else {
+    uint16_t color = ppu->cgram[pixel & 0xff];
+    *r = color & 0x1f;
+    *g = (color >> 5) & 0x1f;
+    *b = (color >> 10) & 0x1f;
+  }
+  if(layer == 4 && pixel < 0xc0) layer = 6; // sprites with palette color < 0xc0
+  return layer;
+}
+
+static inline int ppu_findPixel(Ppu* ppu, int actMode, int x, int y, bool sub, int* pixelOut) {
+  // finds the topmost pixel on main- or subscreen, returns its layer (0-3 bg, 4 sprites, 5 backdrop)
   int layer = 5;
   int pixel = 0;
   for(int i = 0; i < layerCountPerMode[actMode]; i++) {
@@ -432,11 +494,11 @@ static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b
     bool layerActive = false;
     if(!sub) {
       layerActive = ppu->layer[curLayer].mainScreenEnabled && (
-        !ppu->layer[curLayer].mainScreenWindowed || !bg_window_state[curLayer]
+        !ppu->layer[curLayer].mainScreenWindowed || !ppu->bgWindowState[curLayer]
       );
     } else {
       layerActive = ppu->layer[curLayer].subScreenEnabled && (
-        !ppu->layer[curLayer].subScreenWindowed || !bg_window_state[curLayer]
+        !ppu->layer[curLayer].subScreenWindowed || !ppu->bgWindowState[curLayer]
       );
     }
     if(layerActive) {
@@ -464,11 +526,11 @@ static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b
           if(ppu->mode == 2 || ppu->mode == 4 || ppu->mode == 6) {
             ppu_handleOPT(ppu, curLayer, &lx, &ly);
           }
-          if (lx != layerCache[curLayer]) {
+          if (lx != ppu->layerCache[curLayer]) {
             ppu_getPixelForBgLayer(ppu, lx & 0x3ff, ly & 0x3ff, curLayer);
-            layerCache[curLayer] = lx;
+            ppu->layerCache[curLayer] = lx;
           }
-          pixel = (bg_prio_buf[curLayer] == curPriority) ? bg_pixel_buf[curLayer] : 0;
+          pixel = (ppu->bgPrioBuf[curLayer] == curPriority) ? ppu->bgPixelBuf[curLayer] : 0;
         }
       } else {
         // get a pixel from the sprite buffer
@@ -481,17 +543,7 @@ static int ppu_getPixel(Ppu* ppu, int x, int y, bool sub, int* r, int* g, int* b
       break;
     }
   }
-  if(ppu->directColor && layer < 4 && bitDepthsPerMode[actMode][layer] == 8) {
-    *r = ((pixel & 0x7) << 2) | ((pixel & 0x100) >> 7);
-    *g = ((pixel & 0x38) >> 1) | ((pixel & 0x200) >> 8);
-    *b = ((pixel & 0xc0) >> 3) | ((pixel & 0x400) >> 8);
-  } else {
-    uint16_t color = ppu->cgram[pixel & 0xff];
-    *r = color & 0x1f;
-    *g = (color >> 5) & 0x1f;
-    *b = (color >> 10) & 0x1f;
-  }
-  if(layer == 4 && pixel < 0xc0) layer = 6; // sprites with palette color < 0xc0
+  *pixelOut = pixel;
   return layer;
 }
 
@@ -606,8 +658,8 @@ static inline void ppu_getPixelForBgLayer(Ppu* ppu, int x, int y, int layer) {
     } break;
   }
   // return cgram index, or 0 if transparent, palette number in bits 10-8 for 8-color layers
-  bg_pixel_buf[layer] = (pixel == 0) ? 0 : (paletteNum << bitDepth) + pixel;
-  bg_prio_buf[layer] = tilePrio;
+  ppu->bgPixelBuf[layer] = (pixel == 0) ? 0 : (paletteNum << bitDepth) + pixel;
+  ppu->bgPrioBuf[layer] = tilePrio;
 }
 
 static void ppu_calculateMode7Starts(Ppu* ppu, int y) {
@@ -905,12 +957,54 @@ uint8_t ppu_read(Ppu* ppu, uint8_t adr) {
   }
 }
 
+static inline void ppu_writeOam(Ppu* ppu, uint8_t val) {
+  if(ppu->oamInHigh) {
+    ppu->highOam[((ppu->oamAdr & 0xf) << 1) | ppu->oamSecondWrite] = val;
+    if(ppu->oamSecondWrite) {
+      ppu->oamAdr++;
+      if(ppu->oamAdr == 0) ppu->oamInHigh = false;
+    }
+  } else {
+    if(!ppu->oamSecondWrite) {
+      ppu->oamBuffer = val;
+    } else {
+      ppu->oam[ppu->oamAdr++] = (val << 8) | ppu->oamBuffer;
+      if(ppu->oamAdr == 0) ppu->oamInHigh = true;
+    }
+  }
+  ppu->oamSecondWrite = !ppu->oamSecondWrite;
+}
+
+static inline void ppu_writeVram(Ppu* ppu, bool high, uint8_t val) {
+  uint16_t vramAdr = ppu_getVramRemap(ppu) & 0x7fff;
+  if(ppu->forcedBlank || ppu->snes->inVblank) { // TODO: also cgram and oam?
+    ppu->vramPageEpochs[vramAdr >> 7] = ppu->snes->dirtyEpoch;
+    if(high) {
+      ppu->vram[vramAdr] = (ppu->vram[vramAdr] & 0x00ff) | (val << 8);
+    } else {
+      ppu->vram[vramAdr] = (ppu->vram[vramAdr] & 0xff00) | val;
+    }
+  }
+  if(ppu->vramIncrementOnHigh == high) ppu->vramPointer += ppu->vramIncrement;
+}
+
+static inline void ppu_writeCgram(Ppu* ppu, uint8_t val) {
+  if(!ppu->cgramSecondWrite) {
+    ppu->cgramBuffer = val;
+  } else {
+    ppu->cgram[ppu->cgramPointer++] = (val << 8) | ppu->cgramBuffer;
+    ppu->paletteDirty = true;
+  }
+  ppu->cgramSecondWrite = !ppu->cgramSecondWrite;
+}
+
 void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val) {
   switch(adr) {
     case 0x00: {
       // TODO: oam address reset when written on first line of vblank, (and when forced blank is disabled?)
+      if(ppu->brightness != (val & 0xf)) ppu->paletteDirty = true;
       ppu->brightness = val & 0xf;
-      bright_now = bright_lut[ppu->brightness];
+      ppu->brightNow = bright_lut[ppu->brightness];
       ppu->forcedBlank = val & 0x80;
       break;
     }
@@ -936,21 +1030,7 @@ void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val) {
       break;
     }
     case 0x04: {
-      if(ppu->oamInHigh) {
-        ppu->highOam[((ppu->oamAdr & 0xf) << 1) | ppu->oamSecondWrite] = val;
-        if(ppu->oamSecondWrite) {
-          ppu->oamAdr++;
-          if(ppu->oamAdr == 0) ppu->oamInHigh = false;
-        }
-      } else {
-        if(!ppu->oamSecondWrite) {
-          ppu->oamBuffer = val;
-        } else {
-          ppu->oam[ppu->oamAdr++] = (val << 8) | ppu->oamBuffer;
-          if(ppu->oamAdr == 0) ppu->oamInHigh = true;
-        }
-      }
-      ppu->oamSecondWrite = !ppu->oamSecondWrite;
+      ppu_writeOam(ppu, val);
       break;
     }
     case 0x05: {
@@ -1039,19 +1119,11 @@ void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val) {
       break;
     }
     case 0x18: {
-      uint16_t vramAdr = ppu_getVramRemap(ppu);
-	  if (ppu->forcedBlank || ppu->snes->inVblank) { // TODO: also cgram and oam?
-		ppu->vram[vramAdr & 0x7fff] = (ppu->vram[vramAdr & 0x7fff] & 0xff00) | val;
-	  }
-      if(!ppu->vramIncrementOnHigh) ppu->vramPointer += ppu->vramIncrement;
+      ppu_writeVram(ppu, false, val);
       break;
     }
     case 0x19: {
-      uint16_t vramAdr = ppu_getVramRemap(ppu);
-	  if (ppu->forcedBlank || ppu->snes->inVblank) {
-		ppu->vram[vramAdr & 0x7fff] = (ppu->vram[vramAdr & 0x7fff] & 0x00ff) | (val << 8);
-	  }
-      if(ppu->vramIncrementOnHigh) ppu->vramPointer += ppu->vramIncrement;
+      ppu_writeVram(ppu, true, val);
       break;
     }
     case 0x1a: {
@@ -1081,12 +1153,7 @@ void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val) {
       break;
     }
     case 0x22: {
-      if(!ppu->cgramSecondWrite) {
-        ppu->cgramBuffer = val;
-      } else {
-        ppu->cgram[ppu->cgramPointer++] = (val << 8) | ppu->cgramBuffer;
-      }
-      ppu->cgramSecondWrite = !ppu->cgramSecondWrite;
+      ppu_writeCgram(ppu, val);
       break;
     }
     case 0x23:
@@ -1197,32 +1264,120 @@ void ppu_write(Ppu* ppu, uint8_t adr, uint8_t val) {
   }
 }
 
+void ppu_writeBulk(Ppu* ppu, uint8_t adr, bool alternate, const uint8_t* data, int step, int length) {
+  // same as ppu_write for each byte, to adr (alternating with adr ^ 1 if requested), used for dma
+  int i = 0;
+  switch(adr) {
+    case 0x04: {
+      for(; i < length; i++, data += step) ppu_writeOam(ppu, *data);
+      break;
+    }
+    case 0x22: {
+      for(; i < length; i++, data += step) ppu_writeCgram(ppu, *data);
+      break;
+    }
+    case 0x18:
+    case 0x19: {
+      if(alternate && adr == 0x18 && ppu->vramIncrementOnHigh) {
+        // word writes, both bytes go to the same address
+        bool canWrite = ppu->forcedBlank || ppu->snes->inVblank;
+        for(; i + 1 < length; i += 2, data += 2 * step) {
+          if(canWrite) {
+            uint16_t vramAdr = ppu_getVramRemap(ppu) & 0x7fff;
+            ppu->vram[vramAdr] = data[0] | (data[step] << 8);
+            ppu->vramPageEpochs[vramAdr >> 7] = ppu->snes->dirtyEpoch;
+          }
+          ppu->vramPointer += ppu->vramIncrement;
+        }
+      }
+      for(; i < length; i++, data += step) {
+        ppu_writeVram(ppu, (alternate ? adr ^ (i & 1) : adr) == 0x19, *data);
+      }
+      break;
+    }
+    default: {
+      for(; i < length; i++, data += step) ppu_write(ppu, alternate ? adr ^ (i & 1) : adr, *data);
+      break;
+    }
+  }
+}
+
+static void ppu_copyLine(Ppu* ppu, uint16_t* dst, int row) {
+  uint8_t format = ppu->lineFormat[row];
+  if(format == PPU_LINE_RGB565) {
+    uint16_t* src = (uint16_t*)&ppu->pixelBuffer[row * 512];
+    for(int x = 0; x < 256; x++) {
+      dst[x] = src[x];
+    }
+  } else {
+    // expand indexed line through its palette
+    uint8_t* src = &ppu->pixelBuffer[row * 512];
+    uint16_t* palette = ppu->palettes[format / PPU_PALETTE_SLOTS][format % PPU_PALETTE_SLOTS];
+    for(int x = 0; x < 256; x++) {
+      dst[x] = palette[src[x]];
+    }
+  }
+}
+
 void ppu_putPixels(Ppu* ppu, uint8_t* pixels) {
-  for(int y = 0; y < (ppu->frameOverscan ? 239 : 224); y++) {
-    int dest = y + (ppu->frameOverscan ? 2 : 16);
+  // the output has room for 238 overscan lines, and not for the second field of the last one
+  for(int y = 0; y < (ppu->shownOverscan ? 238 : 224); y++) {
+    int dest = y + (ppu->shownOverscan ? 2 : 16);
     int y1 = y, y2 = y + 239;
-    if(!ppu->frameInterlace) {
-      y1 = y + (ppu->evenFrame ? 0 : 239);
+    if(!ppu->shownInterlace) {
+      y1 = y + (ppu->shownEvenFrame ? 0 : 239);
       y2 = y1;
     }
     // Copy line without horizontal doubling
-    uint16_t* src = (uint16_t*)&ppu->pixelBuffer[y1 * 512];
-    uint16_t* dst = (uint16_t*)(pixels + (dest * 320 * 2));
-    for(int x = 0; x < 256; x++) {
-      dst[x] = src[x];
+    ppu_copyLine(ppu, (uint16_t*)(pixels + (dest * 320 * 2)), y1);
+    if(y1 != y2 && dest + 1 < 240) {
+      ppu_copyLine(ppu, (uint16_t*)(pixels + ((dest + 1) * 320 * 2)), y2);
     }
-    if(y1 != y2) {
-      src = (uint16_t*)&ppu->pixelBuffer[y2 * 512];
-      dst = (uint16_t*)(pixels + ((dest + 1) * 320 * 2));
-      for(int x = 0; x < 256; x++) {
-        dst[x] = src[x];
-      }
+  }
+  // Clear top 2 lines, and following 14 and last 16 lines if not overscanning
+  memset(pixels, 0, 320 * 2 * 2);
+  if(!ppu->shownOverscan) {
+    memset(pixels + (2 * 320 * 2), 0, 320 * 2 * 14);
+    memset(pixels + (224 * 320 * 2), 0, 320 * 2 * 16);
+  }
+}
+
+static void ppu_copyLineIndexed(Ppu* ppu, uint8_t* dst, uint8_t* lineFormat, int row) {
+  // indexed lines move 256 bytes, RGB565 lines 512
+  *lineFormat = ppu->lineFormat[row];
+  memcpy(dst, &ppu->pixelBuffer[row * 512], *lineFormat == PPU_LINE_RGB565 ? 512 : 256);
+}
+
+void ppu_putPixelsIndexed(Ppu* ppu, uint8_t* pixels, uint16_t* palettes, uint8_t* lineFormats) {
+  // same layout as ppu_putPixels, but lines with lineFormats[y] != PPU_LINE_RGB565 hold 256 cgram
+  // indices into palettes[lineFormats[y] * 256]; only the palettes in use are copied
+  // the output has room for 238 overscan lines, and not for the second field of the last one
+  for(int y = 0; y < (ppu->shownOverscan ? 238 : 224); y++) {
+    int dest = y + (ppu->shownOverscan ? 2 : 16);
+    int y1 = y, y2 = y + 239;
+    if(!ppu->shownInterlace) {
+      y1 = y + (ppu->shownEvenFrame ? 0 : 239);
+      y2 = y1;
     }
+    ppu_copyLineIndexed(ppu, pixels + (dest * 320 * 2), &lineFormats[dest], y1);
+    if(y1 != y2 && dest + 1 < 240) {
+      ppu_copyLineIndexed(ppu, pixels + ((dest + 1) * 320 * 2), &lineFormats[dest + 1], y2);
+    }
+  }
+  for(int frame = 0; frame < 2; frame++) {
+    if(!ppu->shownInterlace && frame != (ppu->shownEvenFrame ? 0 : 1)) continue;
+    memcpy(
+      &palettes[frame * PPU_PALETTE_SLOTS * 256], ppu->palettes[frame],
+      ppu->paletteCount[frame] * 256 * sizeof(uint16_t)
+    );
   }
   // Clear top 2 lines, and following 14 and last 16 lines if not overscanning
   memset(pixels, 0, 320 * 2 * 2);
-  if(!ppu->frameOverscan) {
+  memset(lineFormats, PPU_LINE_RGB565, 2);
+  if(!ppu->shownOverscan) {
     memset(pixels + (2 * 320 * 2), 0, 320 * 2 * 14);
     memset(pixels + (224 * 320 * 2), 0, 320 * 2 * 16);
+    memset(lineFormats + 2, PPU_LINE_RGB565, 14);
+    memset(lineFormats + 224, PPU_LINE_RGB565, 16);
   }
-} 
\ No newline at end of file
+}
@@ -0,0 +1,211 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rewind.h"
+#include "snes.h"
+#include "input.h"
+
+static inline uint64_t rewind_load(const uint8_t* data);
+static int rewind_pack(Rewind* rw);
+static void rewind_unpack(Rewind* rw, const uint8_t* data, int length);
+static void rewind_store(Rewind* rw, int length);
+static void rewind_dropOldest(Rewind* rw);
+static int rewind_writeCount(uint8_t* data, uint32_t value);
+static uint32_t rewind_readCount(const uint8_t* data, int* pos);
+
+Rewind* rewind_init(Snes* snes, int budget, int interval) {
+  // budget is the amount of bytes for the deltas, interval the amount of frames between captures
+  Rewind* rw = malloc(sizeof(Rewind));
+  rw->snes = snes;
+  rw->interval = interval > 0 ? interval : 1;
+  rw->bufferSize = budget;
+  rw->buffer = malloc(budget);
+  rw->maxEntries = budget / 256 + 16;
+  rw->entries = malloc(rw->maxEntries * sizeof(RewindEntry));
+  rw->stateSize = 0;
+  rw->paddedSize = 0;
+  rw->current = NULL;
+  rw->next = NULL;
+  rw->packed = NULL;
+  rewind_reset(rw);
+  return rw;
+}
+
+void rewind_free(Rewind* rw) {
+  free(rw->buffer);
+  free(rw->entries);
+  free(rw->current);
+  free(rw->next);
+  free(rw->packed);
+  free(rw);
+}
+
+void rewind_reset(Rewind* rw) {
+  // drops all captures; needed after loading a rom or state and after resetting
+  int size = snes_saveState(rw->snes, NULL);
+  if(size != rw->stateSize) {
+    free(rw->current);
+    free(rw->next);
+    free(rw->packed);
+    rw->stateSize = size;
+    rw->paddedSize = (size + 7) & ~7;
+    // padding stays 0, the states are compared per 8 bytes
+    rw->current = calloc(rw->paddedSize, 1);
+    rw->next = calloc(rw->paddedSize, 1);
+    // worst case is a count pair per 2 words, and room for a full count before the data
+    rw->packed = malloc(rw->paddedSize + rw->paddedSize / 8 * 5 + 16);
+  }
+  rw->hasCurrent = false;
+  rw->frameCounter = 0;
+  rw->first = 0;
+  rw->count = 0;
+  rw->head = 0;
+  rw->usedBytes = 0;
+  rw->captures = 0;
+  rw->packedBytes = 0;
+}
+
+void rewind_capture(Rewind* rw) {
+  // call once per frame, after running it
+  if(++rw->frameCounter < rw->interval) return;
+  rw->frameCounter = 0;
+  snes_saveState(rw->snes, rw->next);
+  if(rw->hasCurrent) {
+    int length = rewind_pack(rw);
+    rewind_store(rw, length);
+    rw->packedBytes += length;
+  }
+  uint8_t* temp = rw->current;
+  rw->current = rw->next;
+  rw->next = temp;
+  rw->hasCurrent = true;
+  rw->captures++;
+}
+
+bool rewind_step(Rewind* rw) {
+  // loads the capture before the last one and drops the last one; false if there is none. running a frame
+  // from there shows the frame of the dropped capture again, so repeated steps play the frames backwards
+  if(rw->count == 0) return false;
+  RewindEntry* entry = &rw->entries[(rw->first + rw->count - 1) % rw->maxEntries];
+  rewind_unpack(rw, rw->buffer + entry->offset, entry->length);
+  rw->head = entry->offset;
+  rw->usedBytes -= entry->length;
+  rw->count--;
+  rw->frameCounter = 0;
+  // keep the buttons that are held now
+  uint16_t state1 = rw->snes->input1->currentState;
+  uint16_t state2 = rw->snes->input2->currentState;
+  snes_loadState(rw->snes, rw->current, rw->stateSize);
+  rw->snes->input1->currentState = state1;
+  rw->snes->input2->currentState = state2;
+  return true;
+}
+
+static inline uint64_t rewind_load(const uint8_t* data) {
+  uint64_t value;
+  memcpy(&value, data, 8);
+  return value;
+}
+
+static int rewind_pack(Rewind* rw) {
+  // stores next ^ current as runs of: unchanged words (count), changed words (count, then the xor'ed data)
+  const uint8_t* a = rw->current;
+  const uint8_t* b = rw->next;
+  uint8_t* out = rw->packed;
+  int words = rw->paddedSize / 8;
+  int pos = 0;
+  int i = 0;
+  while(i < words) {
+    int start = i;
+    while(i < words && rewind_load(a + i * 8) == rewind_load(b + i * 8)) i++;
+    pos += rewind_writeCount(out + pos, i - start);
+    start = i;
+    uint64_t delta = 0;
+    while(i < words && (delta = rewind_load(a + i * 8) ^ rewind_load(b + i * 8)) != 0) {
+      memcpy(out + pos + 5 + (i - start) * 8, &delta, 8);
+      i++;
+    }
+    // the data went in after room for the longest count, move it if the count is shorter
+    int countLength = rewind_writeCount(out + pos, i - start);
+    if(countLength != 5) memmove(out + pos + countLength, out + pos + 5, (i - start) * 8);
+    pos += countLength + (i - start) * 8;
+  }
+  return pos;
+}
+
+static void rewind_unpack(Rewind* rw, const uint8_t* data, int length) {
+  // xors the delta into current
+  int pos = 0;
+  int word = 0;
+  while(pos < length) {
+    word += rewind_readCount(data, &pos);
+    int changed = rewind_readCount(data, &pos);
+    for(int j = 0; j < changed; j++) {
+      uint64_t value = rewind_load(rw->current + word * 8) ^ rewind_load(data + pos);
+      memcpy(rw->current + word * 8, &value, 8);
+      pos += 8;
+      word++;
+    }
+  }
+}
+
+static void rewind_store(Rewind* rw, int length) {
+  // puts the packed delta in the ring, dropping the oldest ones to make room
+  if(length > rw->bufferSize) {
+    // does not fit at all, the history ends here
+    while(rw->count > 0) rewind_dropOldest(rw);
+    rw->head = 0;
+    return;
+  }
+  int start = rw->head;
+  if(start + length > rw->bufferSize) {
+    // wrap around; what lies behind the head is the oldest
+    while(rw->count > 0 && rw->entries[rw->first].offset >= start) rewind_dropOldest(rw);
+    start = 0;
+  }
+  while(rw->count > 0 && (
+    rw->count == rw->maxEntries ||
+    (rw->entries[rw->first].offset < start + length && start < rw->entries[rw->first].offset + rw->entries[rw->first].length)
+  )) {
+    rewind_dropOldest(rw);
+  }
+  memcpy(rw->buffer + start, rw->packed, length);
+  RewindEntry* entry = &rw->entries[(rw->first + rw->count) % rw->maxEntries];
+  entry->offset = start;
+  entry->length = length;
+  rw->count++;
+  rw->head = start + length;
+  rw->usedBytes += length;
+}
+
+static void rewind_dropOldest(Rewind* rw) {
+  rw->usedBytes -= rw->entries[rw->first].length;
+  rw->first = (rw->first + 1) % rw->maxEntries;
+  rw->count--;
+}
+
+static int rewind_writeCount(uint8_t* data, uint32_t value) {
+  // 7 bits per byte, high bit set if more follow
+  int pos = 0;
+  while(value >= 0x80) {
+    data[pos++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  data[pos++] = value;
+  return pos;
+}
+
+static uint32_t rewind_readCount(const uint8_t* data, int* pos) {
+  uint32_t value = 0;
+  int shift = 0;
+  while(true) {
+    uint8_t byte = data[(*pos)++];
+    value |= (byte & 0x7f) << shift;
+    if((byte & 0x80) == 0) return value;
+    shift += 7;
+  }
+}
@@ -8,44 +8,35 @@
 
 #include "statehandler.h"
 
-static void sh_writeByte(StateHandler* sh, uint8_t val);
-static uint8_t sh_readByte(StateHandler* sh);
+static void sh_write(StateHandler* sh, uint64_t val, int bytes);
+static uint64_t sh_read(StateHandler* sh, int bytes);
 
-StateHandler* sh_init(bool saving, const uint8_t* data, int size) {
-  StateHandler* sh = malloc(sizeof(StateHandler));
+void sh_init(StateHandler* sh, bool saving, uint8_t* data, int size) {
+  // works on the caller's buffer; when saving without data only the size is counted
   sh->saving = saving;
   sh->offset = 0;
-  if(!saving) {
-    sh->data = malloc(size);
-    memcpy(sh->data, data, size);
-    sh->allocSize = size;
-  } else {
-    sh->data = malloc(512 * 1024);
-    sh->allocSize = 512 * 1024;
-  }
-  return sh;
-}
-
-void sh_free(StateHandler* sh) {
-  free(sh->data);
-  free(sh);
+  sh->data = data;
+  sh->size = data != NULL ? size : 0;
 }
 
-static void sh_writeByte(StateHandler* sh, uint8_t val) {
-  if(sh->offset >= sh->allocSize) {
-    // realloc
-    sh->data = realloc(sh->data, sh->allocSize * 2);
-    sh->allocSize *= 2;
+static void sh_write(StateHandler* sh, uint64_t val, int bytes) {
+  // little endian; past the end of the buffer only the offset moves
+  if(sh->offset + bytes <= sh->size) {
+    uint8_t* dst = sh->data + sh->offset;
+    for(int i = 0; i < bytes; i++) dst[i] = val >> (i * 8);
   }
-  sh->data[sh->offset++] = val;
+  sh->offset += bytes;
 }
 
-static uint8_t sh_readByte(StateHandler* sh) {
-  if(sh->offset >= sh->allocSize) {
-    // reading above data (should never happen)
-    return 0;
+static uint64_t sh_read(StateHandler* sh, int bytes) {
+  uint64_t val = 0;
+  if(sh->offset + bytes <= sh->size) {
+    // reading above data (should never happen) gives 0
+    const uint8_t* src = sh->data + sh->offset;
+    for(int i = 0; i < bytes; i++) val |= (uint64_t) src[i] << (i * 8);
   }
-  return sh->data[sh->offset++];
+  sh->offset += bytes;
+  return val;
 }
 
 void sh_handleBools(StateHandler* sh, ...) {
@@ -55,9 +46,9 @@ void sh_handleBools(StateHandler* sh, ...) {
     bool* v = va_arg(args, bool*);
     if(v == NULL) break;
     if(sh->saving) {
-      sh_writeByte(sh, *v ? 1 : 0);
+      sh_write(sh, *v ? 1 : 0, 1);
     } else {
-      *v = sh_readByte(sh) > 0 ? true : false;
+      *v = sh_read(sh, 1) > 0 ? true : false;
     }
   }
   va_end(args);
@@ -70,9 +61,9 @@ void sh_handleBytes(StateHandler* sh, ...) {
     uint8_t* v = va_arg(args, uint8_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      sh_writeByte(sh, *v);
+      sh_write(sh, *v, 1);
     } else {
-      *v = sh_readByte(sh);
+      *v = sh_read(sh, 1);
     }
   }
   va_end(args);
@@ -85,9 +76,9 @@ void sh_handleBytesS(StateHandler* sh, ...) {
     int8_t* v = va_arg(args, int8_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      sh_writeByte(sh, (uint8_t) *v);
+      sh_write(sh, (uint8_t) *v, 1);
     } else {
-      *v = (int8_t) sh_readByte(sh);
+      *v = (int8_t) sh_read(sh, 1);
     }
   }
   va_end(args);
@@ -100,12 +91,9 @@ void sh_handleWords(StateHandler* sh, ...) {
     uint16_t* v = va_arg(args, uint16_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      uint16_t val = *v;
-      for(int i = 0; i < 16; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      sh_write(sh, *v, 2);
     } else {
-      uint16_t val = 0;
-      for(int i = 0; i < 16; i += 8) val |= sh_readByte(sh) << i;
-      *v = val;
+      *v = sh_read(sh, 2);
     }
   }
   va_end(args);
@@ -118,12 +106,9 @@ void sh_handleWordsS(StateHandler* sh, ...) {
     int16_t* v = va_arg(args, int16_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      uint16_t val = (uint16_t) *v;
-      for(int i = 0; i < 16; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      sh_write(sh, (uint16_t) *v, 2);
     } else {
-      uint16_t val = 0;
-      for(int i = 0; i < 16; i += 8) val |= sh_readByte(sh) << i;
-      *v = (int16_t) val;
+      *v = (int16_t) sh_read(sh, 2);
     }
   }
   va_end(args);
@@ -136,12 +121,9 @@ void sh_handleInts(StateHandler* sh, ...) {
     uint32_t* v = va_arg(args, uint32_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      uint32_t val = *v;
-      for(int i = 0; i < 32; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      sh_write(sh, *v, 4);
     } else {
-      uint32_t val = 0;
-      for(int i = 0; i < 32; i += 8) val |= sh_readByte(sh) << i;
-      *v = val;
+      *v = sh_read(sh, 4);
     }
   }
   va_end(args);
@@ -154,12 +136,9 @@ void sh_handleIntsS(StateHandler* sh, ...) {
     int32_t* v = va_arg(args, int32_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      uint32_t val = (uint32_t) *v;
-      for(int i = 0; i < 32; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      sh_write(sh, (uint32_t) *v, 4);
     } else {
-      uint32_t val = 0;
-      for(int i = 0; i < 32; i += 8) val |= sh_readByte(sh) << i;
-      *v = (int32_t) val;
+      *v = (int32_t) sh_read(sh, 4);
     }
   }
   va_end(args);
@@ -172,12 +151,9 @@ void sh_handleLongLongs(StateHandler* sh, ...) {
     uint64_t* v = va_arg(args, uint64_t*);
     if(v == NULL) break;
     if(sh->saving) {
-      uint64_t val = *v;
-      for(int i = 0; i < 64; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      sh_write(sh, *v, 8);
     } else {
-      uint64_t val = 0;
-      for(int i = 0; i < 64; i += 8) val |= (uint64_t)sh_readByte(sh) << i;
-      *v = val;
+      *v = sh_read(sh, 8);
     }
   }
   va_end(args);
@@ -189,17 +165,13 @@ void sh_handleFloats(StateHandler* sh, ...) {
   while(true) {
     float* v = va_arg(args, float*);
     if(v == NULL) break;
+    uint32_t val = 0;
     if(sh->saving) {
-      uint8_t valData[4] = {};
-      *((float*) valData) = *v;
-      uint32_t val = *((uint32_t*) valData);
-      for(int i = 0; i < 32; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      memcpy(&val, v, 4);
+      sh_write(sh, val, 4);
     } else {
-      uint32_t val = 0;
-      for(int i = 0; i < 32; i += 8) val |= sh_readByte(sh) << i;
-      uint8_t valData[4] = {};
-      *((uint32_t*) valData) = val;
-      *v = *((float*) valData);
+      val = sh_read(sh, 4);
+      memcpy(v, &val, 4);
     }
   }
   va_end(args);
@@ -211,46 +183,48 @@ void sh_handleDoubles(StateHandler* sh, ...) {
   while(true) {
     double* v = va_arg(args, double*);
     if(v == NULL) break;
+    uint64_t val = 0;
     if(sh->saving) {
-      uint8_t valData[8] = {};
-      *((double*) valData) = *v;
-      uint64_t val = *((uint64_t*) valData);
-      for(int i = 0; i < 64; i += 8) sh_writeByte(sh, (val >> i) & 0xff);
+      memcpy(&val, v, 8);
+      sh_write(sh, val, 8);
     } else {
-      uint64_t val = 0;
-      for(int i = 0; i < 64; i += 8) val |= (uint64_t)sh_readByte(sh) << i;
-      uint8_t valData[8] = {};
-      *((uint64_t*) valData) = val;
-      *v = *((double*) valData);
+      val = sh_read(sh, 8);
+      memcpy(v, &val, 8);
     }
   }
   va_end(args);
 }
 
 void sh_handleByteArray(StateHandler* sh, uint8_t* data, int size) {
-  for(int i = 0; i < size; i++) {
+  if(sh->offset + size <= sh->size) {
     if(sh->saving) {
-      sh_writeByte(sh, data[i]);
+      memcpy(sh->data + sh->offset, data, size);
     } else {
-      data[i] = sh_readByte(sh);
+      memcpy(data, sh->data + sh->offset, size);
     }
+  } else if(!sh->saving) {
+    memset(data, 0, size);
   }
+  sh->offset += size;
 }
 
 void sh_handleWordArray(StateHandler* sh, uint16_t* data, int size) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // stored little endian, same as in memory
+  sh_handleByteArray(sh, (uint8_t*) data, size * 2);
+#else
   for(int i = 0; i < size; i++) {
     if(sh->saving) {
-      sh_writeByte(sh, data[i] & 0xff);
-      sh_writeByte(sh, (data[i] >> 8) & 0xff);
+      sh_write(sh, data[i], 2);
     } else {
-      data[i] = sh_readByte(sh);
-      data[i] |= sh_readByte(sh) << 8;
+      data[i] = sh_read(sh, 2);
     }
   }
+#endif
 }
 
 void sh_placeInt(StateHandler* sh, int location, uint32_t value) {
-  while(sh->offset < location + 4) sh_writeByte(sh, 0);
+  if(location + 4 > sh->size) return;
   sh->data[location] = value & 0xff;
   sh->data[location + 1] = (value >> 8) & 0xff;
   sh->data[location + 2] = (value >> 16) & 0xff;
@@ -49,8 +49,7 @@ struct Spc {
   uint8_t param;
 };
 
-Spc* spc_init(void* mem, SpcReadHandler read, SpcWriteHandler write, SpcIdleHandler idle);
-void spc_free(Spc* spc);
+void spc_init(Spc* spc, void* mem, SpcReadHandler read, SpcWriteHandler write, SpcIdleHandler idle);
 void spc_reset(Spc* spc, bool hard);
 void spc_handleState(Spc* spc, StateHandler* sh);
 void spc_runOpcode(Spc* spc);
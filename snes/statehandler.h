@@ -8,12 +8,11 @@
 typedef struct StateHandler {
   bool saving;
   int offset;
-  uint8_t* data;
-  int allocSize;
+  uint8_t* data; // caller's buffer, not owned
+  int size;
 } StateHandler;
 
-StateHandler* sh_init(bool saving, const uint8_t* data, int size);
-void sh_free(StateHandler* sh);
+void sh_init(StateHandler* sh, bool saving, uint8_t* data, int size);
 
 void sh_handleBools(StateHandler* sh, ...);
 void sh_handleBytes(StateHandler* sh, ...);